@@ -10,6 +10,8 @@
 	or
 
 	g++ -O3 bench.c
+
+	add -pthread when fluxsort_mt.h is present
 */
 
 #include <stdlib.h>
@@ -43,6 +45,12 @@ const char *sorts[] = { "*", "qsort", "fluxsort", "quadsort" };
 #if __has_include("fluxsort.h")
   #include "fluxsort.h" // curl "https://raw.githubusercontent.com/scandum/fluxsort/master/src/fluxsort.{c,h}" -o "fluxsort.#1"
 #endif
+#if __has_include("fluxsort_mt.h")
+  #include "fluxsort_mt.h"
+#endif
+#if __has_include("fluxsort_ctx.h")
+  #include "fluxsort_ctx.h"
+#endif
 #if __has_include("gridsort.h")
   #include "gridsort.h" // curl "https://raw.githubusercontent.com/scandum/gridsort/master/src/gridsort.{c,h}" -o "gridsort.#1"
 #endif
@@ -323,6 +331,22 @@ void test_sort(void *array, void *unsorted, void *valid, int minimum, int maximu
 				case 's' + '_' * 32 + 'f' * 1024: fluxsort_size(array, max, size, cmpf); break;
 
 #endif
+#ifdef FLUXSORT_MT_H
+				case 'm' + '_' * 32 + 'f' * 1024: fluxsort_mt(array, max, size, cmpf, 0); break;
+				case 'm' + '_' * 32 + 'q' * 1024: quadsort_mt(array, max, size, cmpf, 0); break;
+#endif
+#ifdef FLUXSORT_CTX_H
+				case 'c' + '_' * 32 + 'f' * 1024: fluxsort_ctx(NULL, array, max, size, cmpf); break;
+				case 'c' + '_' * 32 + 'q' * 1024: quadsort_ctx(NULL, array, max, size, cmpf); break;
+#endif
+#ifdef FLUXSORT_ALLOC_H
+				case 'h' + '_' * 32 + 'f' * 1024: flux_alloc_policy(&flux_policy_hugepage); fluxsort(array, max, size, cmpf); flux_alloc_policy(NULL); break;
+				case 'h' + '_' * 32 + 'q' * 1024: flux_alloc_policy(&flux_policy_hugepage); quadsort(array, max, size, cmpf); flux_alloc_policy(NULL); break;
+				case 'p' + '_' * 32 + 'f' * 1024: flux_alloc_policy(&flux_policy_populate); fluxsort(array, max, size, cmpf); flux_alloc_policy(NULL); break;
+				case 'p' + '_' * 32 + 'q' * 1024: flux_alloc_policy(&flux_policy_populate); quadsort(array, max, size, cmpf); flux_alloc_policy(NULL); break;
+				case 'r' + '_' * 32 + 'f' * 1024: flux_alloc_pin(max * size); flux_alloc_policy(&flux_policy_pinned); fluxsort(array, max, size, cmpf); flux_alloc_policy(NULL); break;
+				case 'r' + '_' * 32 + 'q' * 1024: flux_alloc_pin(max * size); flux_alloc_policy(&flux_policy_pinned); quadsort(array, max, size, cmpf); flux_alloc_policy(NULL); break;
+#endif
 #ifdef GRIDSORT_H
 				case 'g' + 'r' * 32 + 'i' * 1024: gridsort(array, max, size, cmpf); break;
 #endif
@@ -999,7 +1023,7 @@ int main(int argc, char **argv)
 
 #ifndef SKIP_LONGS
 	long long *la_array = (long long *) malloc(max * sizeof(long long));
-	long long *lr_array = (long long *) malloc(mem * sizeof(long long));
+	long long *lr_array = (long long *) calloc(mem, sizeof(long long));
 	long long *lv_array = (long long *) malloc(max * sizeof(long long));
 
 	if (la_array == NULL || lr_array == NULL || lv_array == NULL)
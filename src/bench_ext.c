@@ -0,0 +1,260 @@
+/*
+	To compile use:
+
+	gcc -O3 -pthread bench_ext.c -o bench_ext
+
+	./bench_ext [megabytes] [record size] [memory megabytes] [fan-in] [temp dir]
+
+	Generates a file of random records, sorts it with fluxsort_file() and
+	fluxsort_file_pipe() and verifies the results. The stages of the pipeline
+	are reported for run generation and merging. Every record starts with a 64 bit key followed by a
+	64 bit sequence number, so the record size must be at least 16.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <errno.h>
+
+#include "fluxsort_ext.h"
+
+long long utime()
+{
+	struct timeval now_time;
+
+	gettimeofday(&now_time, NULL);
+
+	return now_time.tv_sec * 1000000LL + now_time.tv_usec;
+}
+
+int cmp_key(const void *a, const void *b)
+{
+	unsigned long long fa, fb;
+
+	memcpy(&fa, a, sizeof(fa));
+	memcpy(&fb, b, sizeof(fb));
+
+	return (fa > fb) - (fa < fb);
+}
+
+// keys are drawn from a range of a quarter of the records so there are plenty
+// of ties to check stability with
+
+unsigned long long rand64(unsigned long long *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+
+	return *seed;
+}
+
+int generate(const char *path, size_t nmemb, size_t size)
+{
+	unsigned long long seed = 88172645463325252ULL, key, range = nmemb / 4 + 1;
+	size_t index, cnt, block = 65536;
+	char *buf;
+	FILE *fp;
+
+	buf = (char *) calloc(block, size);
+	fp = fopen(path, "wb");
+
+	if (buf == NULL || fp == NULL)
+	{
+		free(buf);
+		return 0;
+	}
+
+	for (index = 0 ; index < nmemb ; index += cnt)
+	{
+		for (cnt = 0 ; cnt < block && index + cnt < nmemb ; cnt++)
+		{
+			key = rand64(&seed) % range;
+			memcpy(buf + cnt * size, &key, sizeof(key));
+
+			key = index + cnt;
+			memcpy(buf + cnt * size + sizeof(key), &key, sizeof(key));
+		}
+		if (fwrite(buf, size, cnt, fp) != cnt)
+		{
+			break;
+		}
+	}
+	free(buf);
+
+	return fclose(fp) == 0 && index >= nmemb;
+}
+
+int verify(const char *path, size_t nmemb, size_t size)
+{
+	unsigned long long key, seq, prev_key = 0, prev_seq = 0;
+	size_t index = 0, cnt, pos;
+	char *buf;
+	FILE *fp;
+
+	buf = (char *) malloc(65536 * size);
+	fp = fopen(path, "rb");
+
+	if (buf == NULL || fp == NULL)
+	{
+		free(buf);
+		return 0;
+	}
+
+	while ((cnt = fread(buf, size, 65536, fp)) > 0)
+	{
+		for (pos = 0 ; pos < cnt ; pos++, index++)
+		{
+			memcpy(&key, buf + pos * size, sizeof(key));
+			memcpy(&seq, buf + pos * size + sizeof(key), sizeof(seq));
+
+			if (index && (key < prev_key || (key == prev_key && seq < prev_seq)))
+			{
+				printf("not properly sorted at index %zu\n", index);
+				fclose(fp);
+				free(buf);
+				return 0;
+			}
+			prev_key = key;
+			prev_seq = seq;
+		}
+	}
+	fclose(fp);
+	free(buf);
+
+	if (index != nmemb)
+	{
+		printf("expected %zu records, found %zu\n", nmemb, index);
+		return 0;
+	}
+	return 1;
+}
+
+void print_stage(const char *name, struct flux_ext_stage *stage)
+{
+	printf("|%10s |%10.3f s |%10.1f MB/s |\n", name, stage->busy, stage->busy > 0 ? stage->bytes / 1048576.0 / stage->busy : 0.0);
+}
+
+void print_phase(const char *name, struct flux_ext_phase *phase)
+{
+	printf("\n%s: %.3f s, stalled on I/O for %.3f s (%.0f%%)\n\n", name, phase->elapsed, phase->stall, phase->elapsed > 0 ? 100.0 * phase->stall / phase->elapsed : 0.0);
+
+	print_stage("read", &phase->read);
+	print_stage("cpu", &phase->cpu);
+	print_stage("write", &phase->write);
+}
+
+int main(int argc, char **argv)
+{
+	size_t megabytes = 4096, size = 32, nmemb;
+	struct flux_ext ext = { 256 * 1048576, 64, NULL };
+	struct flux_ext_stats stats;
+	char in_path[4096], out_path[4096];
+	const char *dir;
+	long long start, end;
+	double mb;
+
+	if (argc > 1 && *argv[1])
+	{
+		megabytes = atol(argv[1]);
+	}
+	if (argc > 2 && *argv[2])
+	{
+		size = atol(argv[2]);
+	}
+	if (argc > 3 && *argv[3])
+	{
+		ext.memory = atol(argv[3]) * 1048576;
+	}
+	if (argc > 4 && *argv[4])
+	{
+		ext.fan_in = atol(argv[4]);
+	}
+	if (argc > 5 && *argv[5])
+	{
+		ext.temp_dir = argv[5];
+	}
+
+	if (size < 16)
+	{
+		printf("record size must be at least 16\n");
+		return 1;
+	}
+	dir = ext.temp_dir ? ext.temp_dir : getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+
+	snprintf(in_path, sizeof(in_path), "%s/bench_ext.in", dir);
+	snprintf(out_path, sizeof(out_path), "%s/bench_ext.out", dir);
+
+	nmemb = megabytes * 1048576 / size;
+	mb = (double) nmemb * size / 1048576;
+
+	printf("Benchmark: %zu records of %zu bytes (%.0f MB), memory: %zu MB, fan-in: %zu, temp dir: %s\n\n", nmemb, size, mb, ext.memory / 1048576, ext.fan_in, dir);
+
+	start = utime();
+
+	if (!generate(in_path, nmemb, size))
+	{
+		printf("generate %s: %s\n", in_path, strerror(errno));
+		return 1;
+	}
+	end = utime();
+
+	printf("|%10s |%10.3f s |%10.1f MB/s |\n", "generate", (end - start) / 1000000.0, mb / ((end - start) / 1000000.0));
+
+	start = utime();
+
+	if (!fluxsort_file(in_path, out_path, size, cmp_key, &ext))
+	{
+		printf("fluxsort_file: %s\n", strerror(errno));
+		unlink(in_path);
+		return 1;
+	}
+	end = utime();
+
+	printf("|%10s |%10.3f s |%10.1f MB/s |\n", "sort", (end - start) / 1000000.0, mb / ((end - start) / 1000000.0));
+
+	start = utime();
+
+	if (!verify(out_path, nmemb, size))
+	{
+		unlink(in_path);
+		unlink(out_path);
+		return 1;
+	}
+	end = utime();
+
+	printf("|%10s |%10.3f s |%10.1f MB/s |\n", "verify", (end - start) / 1000000.0, mb / ((end - start) / 1000000.0));
+
+	start = utime();
+
+	if (!fluxsort_file_pipe(in_path, out_path, size, cmp_key, &ext, &stats))
+	{
+		printf("fluxsort_file_pipe: %s\n", strerror(errno));
+		unlink(in_path);
+		unlink(out_path);
+		return 1;
+	}
+	end = utime();
+
+	printf("|%10s |%10.3f s |%10.1f MB/s |\n", "pipe sort", (end - start) / 1000000.0, mb / ((end - start) / 1000000.0));
+
+	if (!verify(out_path, nmemb, size))
+	{
+		unlink(in_path);
+		unlink(out_path);
+		return 1;
+	}
+
+	print_phase("run generation", &stats.runs);
+
+	printf("\n%zu runs, %zu merge passes\n", stats.run_count, stats.passes);
+
+	print_phase("merge", &stats.merge);
+
+	unlink(in_path);
+	unlink(out_path);
+
+	return 0;
+}
@@ -4,6 +4,82 @@
 
 void FUNC(flux_partition)(VAR *array, VAR *swap, VAR *ptx, VAR *ptp, size_t nmemb, CMPFUNC *cmp);
 
+#ifdef FLUX_PRIM
+
+// Random primitives are distributed over up to 2048 buckets by the most
+// significant bits of their distance to the minimum, after which every
+// bucket is sorted with flux_partition() or quadsort_swap(). This replaces
+// the top partitioning levels with a single stable pass. The scatter is
+// slower than the vectorized partition however, so it's only used when no
+// partition kernels are available.
+
+#ifndef FLUX_RADIX
+  #define FLUX_RADIX 1048576
+#endif
+
+void FUNC(flux_radix)(VAR *array, VAR *swap, size_t nmemb, CMPFUNC *cmp)
+{
+	size_t count[2048], index, offset, cnt, buckets, shift;
+	unsigned long long diff;
+	VAR min, max, *pta;
+
+	min = max = array[0];
+
+	for (pta = array + 1 ; pta < array + nmemb ; pta++)
+	{
+		min = *pta < min ? *pta : min;
+		max = *pta > max ? *pta : max;
+	}
+
+	if (min == max)
+	{
+		return;
+	}
+	diff = (unsigned long long) max - (unsigned long long) min;
+
+	buckets = nmemb >= 4194304 ? 2048 : 256;
+
+	for (shift = 0 ; (diff >> shift) >= buckets ; shift++) {}
+
+	memset(count, 0, buckets * sizeof(size_t));
+
+	for (pta = array ; pta < array + nmemb ; pta++)
+	{
+		count[((unsigned long long) *pta - (unsigned long long) min) >> shift]++;
+	}
+
+	for (index = offset = 0 ; index < buckets ; index++)
+	{
+		cnt = count[index]; count[index] = offset; offset += cnt;
+	}
+
+	for (pta = array ; pta < array + nmemb ; pta++)
+	{
+		swap[count[((unsigned long long) *pta - (unsigned long long) min) >> shift]++] = *pta;
+	}
+
+	for (index = offset = 0 ; index < buckets ; index++)
+	{
+		cnt = count[index] - offset;
+
+		memcpy(array + offset, swap + offset, cnt * sizeof(VAR));
+
+		// with a shift of 0 every bucket holds a single value
+
+		if (shift && cnt <= FLUX_OUT)
+		{
+			FUNC(quadsort_swap)(array + offset, swap + offset, cnt, cnt, cmp);
+		}
+		else if (shift)
+		{
+			FUNC(flux_partition)(array + offset, swap + offset, array + offset, swap + offset + cnt, cnt, cmp);
+		}
+		offset = count[index];
+	}
+}
+
+#endif
+
 // Determine whether to use mergesort or quicksort
 
 void FUNC(flux_analyze)(VAR *array, VAR *swap, size_t swap_size, size_t nmemb, CMPFUNC *cmp)
@@ -124,6 +200,17 @@ void FUNC(flux_analyze)(VAR *array, VAR *swap, size_t swap_size, size_t nmemb, C
 	switch (asum + bsum * 2 + csum * 4 + dsum * 8)
 	{
 		case 0:
+#ifdef FLUX_PRIM
+  #ifdef FLUX_SIMD
+			if (nmemb >= FLUX_RADIX && flux_simd_level() == FLUX_SCALAR)
+  #else
+			if (nmemb >= FLUX_RADIX)
+  #endif
+			{
+				FUNC(flux_radix)(array, swap, nmemb, cmp);
+				return;
+			}
+#endif
 			FUNC(flux_partition)(array, swap, array, swap + nmemb, nmemb, cmp);
 			return;
 		case 1:
@@ -308,16 +395,28 @@ VAR FUNC(median_of_cbrt)(VAR *array, VAR *swap, VAR *ptx, size_t nmemb, int *gen
 
 // As per suggestion by Marshall Lochbaum to improve generic data handling by mimicking dual-pivot quicksort
 
-void FUNC(flux_reverse_partition)(VAR *array, VAR *swap, VAR *ptx, VAR *piv, size_t nmemb, CMPFUNC *cmp)
+// Moves the elements smaller than the pivot to the front and returns their
+// number, the elements equal to the pivot follow in their original order.
+
+size_t FUNC(flux_reverse_split)(VAR *array, VAR *swap, VAR *ptx, VAR *piv, size_t nmemb, CMPFUNC *cmp)
 {
-	size_t a_size, s_size;
+	size_t a_size = 0, s_size = 0;
+
+#if defined FLUX_SIMD && defined FLUX_PRIM
+	{
+		size_t run, cnt = FUNC(flux_simd_split)(array, swap, ptx, *piv, nmemb, 1, &a_size, &run);
 
+		s_size = cnt - a_size;
+		ptx += cnt;
+		nmemb -= cnt;
+	}
+#endif
 #if !defined __clang__
 	{
 		size_t cnt, m, val;
-		VAR *pts = swap;
+		VAR *pts = swap + a_size + s_size;
 
-		for (m = 0, cnt = nmemb / 8 ; cnt ; cnt--)
+		for (m = a_size, cnt = nmemb / 8 ; cnt ; cnt--)
 		{
 			val = cmp(piv, ptx) > 0; pts[-m] = array[m] = *ptx++; m += val; pts++;
 			val = cmp(piv, ptx) > 0; pts[-m] = array[m] = *ptx++; m += val; pts++;
@@ -334,12 +433,12 @@ void FUNC(flux_reverse_partition)(VAR *array, VAR *swap, VAR *ptx, VAR *piv, siz
 			val = cmp(piv, ptx) > 0; pts[-m] = array[m] = *ptx++; m += val; pts++;
 		}
 		a_size = m;
-		s_size = nmemb - a_size;
+		s_size = pts - swap - m;
 	}
 #else
 	{
 		size_t cnt;
-		VAR *tmp, *pta = array, *pts = swap;
+		VAR *tmp, *pta = array + a_size, *pts = swap + s_size;
 
 		for (cnt = nmemb / 8 ; cnt ; cnt--)
 		{
@@ -363,6 +462,14 @@ void FUNC(flux_reverse_partition)(VAR *array, VAR *swap, VAR *ptx, VAR *piv, siz
 #endif
 	memcpy(array + a_size, swap, s_size * sizeof(VAR));
 
+	return a_size;
+}
+
+void FUNC(flux_reverse_partition)(VAR *array, VAR *swap, VAR *ptx, VAR *piv, size_t nmemb, CMPFUNC *cmp)
+{
+	size_t a_size = FUNC(flux_reverse_split)(array, swap, ptx, piv, nmemb, cmp);
+	size_t s_size = nmemb - a_size;
+
 	if (s_size <= a_size / 16 || a_size <= FLUX_OUT)
 	{
 		FUNC(quadsort_swap)(array, swap, a_size, a_size, cmp);
@@ -375,10 +482,14 @@ size_t FUNC(flux_default_partition)(VAR *array, VAR *swap, VAR *ptx, VAR *piv, s
 {
 	size_t run = 0, a = 0, m = 0;
 
+#if defined FLUX_SIMD && defined FLUX_PRIM
+	a = FUNC(flux_simd_split)(array, swap, ptx, *piv, nmemb, 0, &m, &run);
+	ptx += a;
+#endif
 #if !defined __clang__
 	size_t val;
 
-	for (a = 8 ; a <= nmemb ; a += 8)
+	for (swap += a, a += 8 ; a <= nmemb ; a += 8)
 	{
 		val = cmp(ptx, piv) <= 0; swap[-m] = array[m] = *ptx++; m += val; swap++;
 		val = cmp(ptx, piv) <= 0; swap[-m] = array[m] = *ptx++; m += val; swap++;
@@ -398,9 +509,9 @@ size_t FUNC(flux_default_partition)(VAR *array, VAR *swap, VAR *ptx, VAR *piv, s
 	}
 	swap -= nmemb;
 #else
-	VAR *tmp, *pta = array, *pts = swap;
+	VAR *tmp, *pta = array + m, *pts = swap + a - m;
 
-	for (a = 8 ; a <= nmemb ; a += 8)
+	for (a += 8 ; a <= nmemb ; a += 8)
 	{
 		tmp = cmp(ptx, piv) <= 0 ? pta++ : pts++; *tmp = *ptx++;
 		tmp = cmp(ptx, piv) <= 0 ? pta++ : pts++; *tmp = *ptx++;
@@ -523,7 +634,8 @@ void FUNC(fluxsort)(void *array, size_t nmemb, CMPFUNC *cmp)
 	else
 	{
 		VAR *pta = (VAR *) array;
-		VAR *swap = (VAR *) malloc(nmemb * sizeof(VAR));
+		struct flux_alloc *policy = flux_swap_policy;
+		VAR *swap = (VAR *) policy->alloc(nmemb * sizeof(VAR));
 
 		if (swap == NULL)
 		{
@@ -532,7 +644,7 @@ void FUNC(fluxsort)(void *array, size_t nmemb, CMPFUNC *cmp)
 		}
 		FUNC(flux_analyze)(pta, swap, nmemb, nmemb, cmp);
 
-		free(swap);
+		policy->release(swap, nmemb * sizeof(VAR));
 	}
 }
 
@@ -550,3 +662,1003 @@ void FUNC(fluxsort_swap)(void *array, void *swap, size_t swap_size, size_t nmemb
 		FUNC(flux_analyze)(pta, pts, swap_size, nmemb, cmp);
 	}
 }
+
+// The next three functions sort with a swap smaller than nmemb. Partitions
+// that don't fit in swap are split in place: each half is partitioned
+// recursively and the two middle parts are swapped with a rotation, so the
+// partition stays stable at the cost of O(n log (n / swap_size)) moves.
+
+size_t FUNC(flux_budget_split)(VAR *array, VAR *swap, size_t swap_size, VAR *piv, size_t nmemb, int reverse, CMPFUNC *cmp)
+{
+	size_t half, m1, m2;
+
+	if (nmemb <= swap_size * 2)
+	{
+		VAR *tmp, *pta = array, *pts = swap, *ptx = array, *pte = swap + swap_size;
+
+		// elements going right are buffered in swap, when it fills up the rest
+		// is split separately
+
+		if (reverse)
+		{
+			for (half = nmemb ; half && pts < pte ; half--)
+			{
+				tmp = cmp(piv, ptx) > 0 ? pta++ : pts++; *tmp = *ptx++;
+			}
+		}
+		else
+		{
+			for (half = nmemb ; half && pts < pte ; half--)
+			{
+				tmp = cmp(ptx, piv) <= 0 ? pta++ : pts++; *tmp = *ptx++;
+			}
+		}
+		memcpy(pta, swap, (pts - swap) * sizeof(VAR));
+
+		if (half == 0)
+		{
+			return pta - array;
+		}
+		m1 = pta - array;
+		half = nmemb - half;
+	}
+	else
+	{
+		half = nmemb / 2;
+
+		m1 = FUNC(flux_budget_split)(array, swap, swap_size, piv, half, reverse, cmp);
+	}
+	m2 = FUNC(flux_budget_split)(array + half, swap, swap_size, piv, nmemb - half, reverse, cmp);
+
+	if (m1 < half && m2)
+	{
+		FUNC(trinity_rotation)(array + m1, swap, swap_size, half - m1 + m2, half - m1);
+	}
+	return m1 + m2;
+}
+
+// Like flux_partition(), a pivot equal to the previous pivot triggers a
+// reverse partition, which removes the elements equal to the pivot.
+
+void FUNC(flux_budget_partition)(VAR *array, VAR *swap, size_t swap_size, size_t nmemb, CMPFUNC *cmp)
+{
+	VAR piv, prev;
+	size_t cbrt, a_size, s_size;
+	int generic = 0, have_prev = 0;
+
+	while (nmemb > swap_size)
+	{
+		for (cbrt = 32 ; nmemb > cbrt * cbrt * cbrt ; cbrt *= 2) {}
+
+		if (cbrt * 3 <= swap_size)
+		{
+			piv = FUNC(median_of_cbrt)(array, swap, array, nmemb, &generic, cmp);
+
+			if (generic)
+			{
+				FUNC(quadsort_swap)(array, swap, swap_size, nmemb, cmp);
+				return;
+			}
+		}
+		else
+		{
+			piv = FUNC(median_of_nine)(array, nmemb, cmp);
+		}
+
+		if (have_prev && cmp(&prev, &piv) <= 0)
+		{
+			nmemb = FUNC(flux_budget_split)(array, swap, swap_size, &piv, nmemb, 1, cmp);
+			continue;
+		}
+		a_size = FUNC(flux_budget_split)(array, swap, swap_size, &piv, nmemb, 0, cmp);
+		s_size = nmemb - a_size;
+
+		if (s_size)
+		{
+			FUNC(flux_budget_partition)(array + a_size, swap, swap_size, s_size, cmp);
+		}
+		prev = piv;
+		have_prev = 1;
+		nmemb = a_size;
+	}
+
+	if (nmemb <= FLUX_OUT)
+	{
+		FUNC(quadsort_swap)(array, swap, nmemb, nmemb, cmp);
+	}
+	else
+	{
+		FUNC(flux_partition)(array, swap, array, swap + nmemb, nmemb, cmp);
+	}
+}
+
+// Estimates the number of distinct values from a sorted sample of up to 1024
+// elements. If most sampled values repeat the sample holds nearly all of them,
+// otherwise the number of repeats gives the birthday estimate of
+// sample * sample / (2 * repeats).
+
+size_t FUNC(flux_budget_distinct)(VAR *array, VAR *swap, size_t swap_size, size_t nmemb, CMPFUNC *cmp)
+{
+	size_t cnt, div, sample, distinct;
+	VAR *pta = array;
+
+	sample = swap_size / 2 < 1024 ? swap_size / 2 : 1024;
+	div = nmemb / sample;
+
+	for (cnt = 0 ; cnt < sample ; cnt++)
+	{
+		swap[cnt] = *pta;
+
+		pta += div;
+	}
+	FUNC(quadsort_swap)(swap, swap + sample, sample, sample, cmp);
+
+	for (cnt = distinct = 1 ; cnt < sample ; cnt++)
+	{
+		distinct += cmp(swap + cnt, swap + cnt - 1) > 0;
+	}
+
+	if (distinct * 2 <= sample)
+	{
+		return distinct;
+	}
+
+	if (distinct == sample)
+	{
+		return nmemb;
+	}
+	distinct = sample * sample / (2 * (sample - distinct));
+
+	return distinct < nmemb ? distinct : nmemb;
+}
+
+// Sorts with a swap of swap_size elements, which may be smaller than nmemb.
+// Swaps of 512 elements or less are replaced with a 512 element stack buffer.
+// The in place splits cost a rotation per level for every partition that
+// doesn't fit, so with a swap below a quarter of nmemb quadsort's rotate merges
+// are faster on random data. Each level of partitioning removes the elements
+// equal to a pivot however, so the split still wins if the pivot sample shows
+// few distinct values, at most 64, or at most a quarter of the swap with a swap
+// of at least nmemb / 16.
+
+void FUNC(fluxsort_budget_swap)(void *array, void *swap, size_t swap_size, size_t nmemb, CMPFUNC *cmp)
+{
+	VAR *pta = (VAR *) array;
+	VAR *pts = (VAR *) swap;
+	VAR stack[512];
+	size_t distinct;
+
+	if (swap_size >= nmemb)
+	{
+		FUNC(fluxsort_swap)(array, swap, swap_size, nmemb, cmp);
+		return;
+	}
+
+	if (swap_size <= 512)
+	{
+		FUNC(quadsort_swap)(pta, stack, 512, nmemb, cmp);
+		return;
+	}
+
+	if (swap_size >= nmemb / 4)
+	{
+		FUNC(flux_budget_partition)(pta, pts, swap_size, nmemb, cmp);
+	}
+	else
+	{
+		distinct = FUNC(flux_budget_distinct)(pta, pts, swap_size, nmemb, cmp);
+
+		if (distinct <= 64 || (swap_size >= nmemb / 16 && distinct * 4 <= swap_size))
+		{
+			FUNC(flux_budget_partition)(pta, pts, swap_size, nmemb, cmp);
+		}
+		else
+		{
+			FUNC(quadsort_swap)(pta, pts, swap_size, nmemb, cmp);
+		}
+	}
+}
+
+// Sorts with at most swap_size elements of swap from flux_swap_policy. Budgets
+// of 512 elements or less, and sorts for which the allocation fails, use
+// quadsort with a 512 element stack buffer instead.
+
+void FUNC(fluxsort_budget)(void *array, size_t nmemb, size_t swap_size, CMPFUNC *cmp)
+{
+	struct flux_alloc *policy = flux_swap_policy;
+	VAR *swap;
+
+	if (swap_size >= nmemb)
+	{
+		FUNC(fluxsort)(array, nmemb, cmp);
+		return;
+	}
+	swap = swap_size > 512 ? (VAR *) policy->alloc(swap_size * sizeof(VAR)) : NULL;
+
+	if (swap == NULL)
+	{
+		FUNC(fluxsort_budget_swap)(array, NULL, 0, nmemb, cmp);
+		return;
+	}
+	FUNC(fluxsort_budget_swap)(array, swap, swap_size, nmemb, cmp);
+
+	policy->release(swap, swap_size * sizeof(VAR));
+}
+
+
+// The next three functions merge k sorted runs into dest with a loser tree.
+// Leaves sit at k to 2k - 1 and every internal node holds the loser of the
+// match played there. A match compares the lower run index first, so ties go
+// to the earlier run and the merge is stable. The tree is kept on the stack,
+// so at most FLUX_MERGE_K runs are merged at once.
+
+#ifndef FLUX_MERGE_K
+  #define FLUX_MERGE_K 64
+#endif
+
+size_t FUNC(flux_merge_k_build)(VAR **ptrs, size_t *tree, size_t k, size_t node, CMPFUNC *cmp)
+{
+	size_t lo, hi, x;
+
+	if (node >= k)
+	{
+		return node - k;
+	}
+	lo = FUNC(flux_merge_k_build)(ptrs, tree, k, node * 2, cmp);
+	hi = FUNC(flux_merge_k_build)(ptrs, tree, k, node * 2 + 1, cmp);
+
+	if (lo > hi)
+	{
+		x = lo; lo = hi; hi = x;
+	}
+	x = cmp(ptrs[lo], ptrs[hi]) <= 0;
+
+	tree[node] = x ? hi : lo;
+
+	return x ? lo : hi;
+}
+
+// A drained run is dropped and the tree rebuilt over the remaining runs, so
+// the replay needs no end of run checks. The last two runs are finished with
+// twin_merge. Returns the number of elements written. K is at most
+// FLUX_MERGE_K, the bound on live tells the compiler the tree can't overflow.
+
+size_t FUNC(flux_merge_k_group)(VAR **runs, size_t *lengths, size_t k, VAR *dest, CMPFUNC *cmp)
+{
+	VAR *ptrs[FLUX_MERGE_K], *ends[FLUX_MERGE_K], *ptd = dest;
+	size_t tree[FLUX_MERGE_K], cnt, live, winner, node, lo, hi, x;
+
+	for (cnt = live = 0 ; cnt < k ; cnt++)
+	{
+		if (lengths[cnt])
+		{
+			ptrs[live] = runs[cnt];
+			ends[live++] = runs[cnt] + lengths[cnt];
+		}
+	}
+
+	while (live > 2 && live <= FLUX_MERGE_K)
+	{
+		winner = FUNC(flux_merge_k_build)(ptrs, tree, live, 1, cmp);
+
+		while (1)
+		{
+			*ptd++ = *ptrs[winner]++;
+
+			if (ptrs[winner] == ends[winner])
+			{
+				break;
+			}
+
+			for (node = (winner + live) / 2 ; node ; node /= 2)
+			{
+				lo = tree[node] < winner ? tree[node] : winner;
+				hi = tree[node] ^ winner ^ lo;
+
+				x = cmp(ptrs[lo], ptrs[hi]) <= 0;
+
+				tree[node] = x ? hi : lo;
+				winner = x ? lo : hi;
+			}
+		}
+		live--;
+
+		memmove(ptrs + winner, ptrs + winner + 1, (live - winner) * sizeof(VAR *));
+		memmove(ends + winner, ends + winner + 1, (live - winner) * sizeof(VAR *));
+	}
+
+	if (live == 2)
+	{
+		FUNC(twin_merge)(ptd, ptrs[0], ptrs[1], ends[0] - ptrs[0], ends[1] - ptrs[1], cmp);
+
+		ptd += (ends[0] - ptrs[0]) + (ends[1] - ptrs[1]);
+	}
+	else if (live == 1)
+	{
+		memcpy(ptd, ptrs[0], (ends[0] - ptrs[0]) * sizeof(VAR));
+
+		ptd += ends[0] - ptrs[0];
+	}
+	return ptd - dest;
+}
+
+// Allocates no memory. Groups of FLUX_MERGE_K runs are merged behind each
+// other in dest, and every group is merged in place with the groups in front
+// of it using the rotation merges of quadsort and a stack swap.
+
+void FUNC(flux_merge_k_tree)(VAR **runs, size_t *lengths, size_t k, VAR *dest, CMPFUNC *cmp)
+{
+	VAR stack[512];
+	size_t cnt, grp, left, right;
+
+	for (cnt = left = 0 ; cnt < k ; cnt += grp)
+	{
+		grp = k - cnt < FLUX_MERGE_K ? k - cnt : FLUX_MERGE_K;
+
+		right = FUNC(flux_merge_k_group)(runs + cnt, lengths + cnt, grp, dest + left, cmp);
+
+		if (left == 0 || right == 0)
+		{
+			left += right;
+			continue;
+		}
+
+		if (right <= 512)
+		{
+			FUNC(partial_backward_merge)(dest, stack, 512, left + right, left, cmp);
+		}
+		else if (left <= 512)
+		{
+			FUNC(partial_forward_merge)(dest, stack, 512, left + right, left, cmp);
+		}
+		else
+		{
+			FUNC(rotate_merge_block)(dest, stack, 512, left, right, cmp);
+		}
+		left += right;
+	}
+}
+
+// Merges the runs pairwise, the first pass with twin_merge from the runs and
+// every next pass with cross_merge between dest and swap, the side the first
+// pass writes to is picked so the last pass ends in dest. Lengths is used to
+// hold the lengths of the merged runs.
+
+void FUNC(flux_merge_k_pairs)(VAR **runs, size_t *lengths, size_t k, VAR *dest, VAR *swap, CMPFUNC *cmp)
+{
+	VAR *pta, *ptd, *tmp;
+	size_t cnt, pass, left, right;
+
+	for (cnt = 1, pass = 0 ; cnt < k ; cnt *= 2)
+	{
+		pass++;
+	}
+	pta = pass & 1 ? dest : swap;
+	ptd = pass & 1 ? swap : dest;
+
+	tmp = pta;
+
+	for (cnt = 0 ; cnt < k ; cnt += 2)
+	{
+		left = lengths[cnt];
+		right = cnt + 1 < k ? lengths[cnt + 1] : 0;
+
+		if (left && right)
+		{
+			FUNC(twin_merge)(tmp, runs[cnt], runs[cnt + 1], left, right, cmp);
+		}
+		else
+		{
+			memcpy(tmp, runs[cnt], left * sizeof(VAR));
+			memcpy(tmp + left, runs[cnt + (right != 0)], right * sizeof(VAR));
+		}
+		lengths[cnt / 2] = left + right;
+		tmp += left + right;
+	}
+	k = (k + 1) / 2;
+
+	while (k > 1)
+	{
+		VAR *from = pta, *to = ptd;
+
+		for (cnt = 0 ; cnt < k ; cnt += 2)
+		{
+			left = lengths[cnt];
+			right = cnt + 1 < k ? lengths[cnt + 1] : 0;
+
+			if (left && right)
+			{
+				FUNC(cross_merge)(to, from, left, right, cmp);
+			}
+			else
+			{
+				memcpy(to, from, (left + right) * sizeof(VAR));
+			}
+			lengths[cnt / 2] = left + right;
+			from += left + right;
+			to += left + right;
+		}
+		k = (k + 1) / 2;
+
+		tmp = pta; pta = ptd; ptd = tmp;
+	}
+}
+
+// Dest may not overlap the runs. More than two runs are merged pairwise,
+// which is faster than the loser tree because every merge is branchless, but
+// it needs a swap as large as the output. The loser tree is used if the swap
+// can't be allocated.
+
+void FUNC(fluxsort_merge_k)(void **runs, size_t *lengths, size_t k, void *dest, CMPFUNC *cmp)
+{
+	struct flux_alloc *policy = flux_swap_policy;
+	VAR **ptr = (VAR **) runs;
+	VAR *swap;
+	size_t cnt, nmemb, *len;
+
+	if (k <= 2)
+	{
+		FUNC(flux_merge_k_tree)(ptr, lengths, k, (VAR *) dest, cmp);
+		return;
+	}
+
+	for (cnt = nmemb = 0 ; cnt < k ; cnt++)
+	{
+		nmemb += lengths[cnt];
+	}
+	swap = (VAR *) policy->alloc(nmemb * sizeof(VAR));
+	len = (size_t *) malloc(k * sizeof(size_t));
+
+	if (swap == NULL || len == NULL)
+	{
+		if (swap)
+		{
+			policy->release(swap, nmemb * sizeof(VAR));
+		}
+		free(len);
+
+		FUNC(flux_merge_k_tree)(ptr, lengths, k, (VAR *) dest, cmp);
+		return;
+	}
+	memcpy(len, lengths, k * sizeof(size_t));
+
+	FUNC(flux_merge_k_pairs)(ptr, len, k, (VAR *) dest, swap, cmp);
+
+	policy->release(swap, nmemb * sizeof(VAR));
+	free(len);
+}
+
+// The next two functions sort the k smallest elements to the front, the
+// elements past k are left in unspecified order. Only partitions that overlap
+// the first k elements are partitioned further, a partition that lies before
+// k is sorted in full. The partitions are stable, so the front is the same as
+// that of a full sort.
+
+void FUNC(flux_partial)(VAR *array, VAR *swap, VAR *ptx, VAR *piv, size_t nmemb, size_t k, CMPFUNC *cmp)
+{
+	size_t a_size = 0, s_size;
+	int generic = 0;
+
+	while (1)
+	{
+		if (nmemb <= FLUX_OUT)
+		{
+			if (ptx == swap)
+			{
+				memcpy(array, swap, nmemb * sizeof(VAR));
+			}
+			FUNC(quadsort_swap)(array, swap, nmemb, nmemb, cmp);
+			return;
+		}
+
+		if (k >= nmemb)
+		{
+			FUNC(flux_partition)(array, swap, ptx, piv, nmemb, cmp);
+			return;
+		}
+		--piv;
+
+		if (nmemb <= 2048)
+		{
+			*piv = FUNC(median_of_nine)(ptx, nmemb, cmp);
+		}
+		else
+		{
+			*piv = FUNC(median_of_cbrt)(array, swap, ptx, nmemb, &generic, cmp);
+
+			if (generic)
+			{
+				if (ptx == swap)
+				{
+					memcpy(array, swap, nmemb * sizeof(VAR));
+				}
+				FUNC(quadsort_swap)(array, swap, nmemb, nmemb, cmp);
+				return;
+			}
+		}
+
+		// the elements equal to the pivot end up behind the smaller ones in
+		// their original order, so only the smaller ones are left to sort
+
+		if (a_size && cmp(piv + 1, piv) <= 0)
+		{
+			a_size = FUNC(flux_reverse_split)(array, swap, array, piv, nmemb, cmp);
+
+			nmemb = a_size;
+			a_size = 0;
+			continue;
+		}
+		a_size = FUNC(flux_default_partition)(array, swap, ptx, piv, nmemb, cmp);
+		s_size = nmemb - a_size;
+
+		if (a_size == 0)
+		{
+			return;
+		}
+
+		if (s_size == 0)
+		{
+			a_size = FUNC(flux_reverse_split)(array, swap, array, piv, nmemb, cmp);
+
+			nmemb = a_size;
+			a_size = 0;
+			ptx = array;
+			continue;
+		}
+
+		if (k > a_size)
+		{
+			FUNC(flux_partial)(array + a_size, swap, swap, piv, s_size, k - a_size, cmp);
+
+			if (a_size <= FLUX_OUT)
+			{
+				FUNC(quadsort_swap)(array, swap, a_size, a_size, cmp);
+			}
+			else if (s_size <= a_size / 32)
+			{
+				FUNC(flux_reverse_partition)(array, swap, array, piv, a_size, cmp);
+			}
+			else
+			{
+				FUNC(flux_partition)(array, swap, array, piv, a_size, cmp);
+			}
+			return;
+		}
+		memcpy(array + a_size, swap, s_size * sizeof(VAR));
+
+		nmemb = a_size;
+		ptx = array;
+	}
+}
+
+void FUNC(fluxsort_partial)(void *array, size_t nmemb, size_t k, CMPFUNC *cmp)
+{
+	if (k >= nmemb || nmemb <= 132)
+	{
+		FUNC(fluxsort)(array, nmemb, cmp);
+	}
+	else if (k)
+	{
+		VAR *pta = (VAR *) array;
+		struct flux_alloc *policy = flux_swap_policy;
+		VAR *swap = (VAR *) policy->alloc(nmemb * sizeof(VAR));
+
+		if (swap == NULL)
+		{
+			FUNC(quadsort)(array, nmemb, cmp);
+			return;
+		}
+		FUNC(flux_partial)(pta, swap, pta, swap + nmemb, nmemb, k, cmp);
+
+		policy->release(swap, nmemb * sizeof(VAR));
+	}
+}
+
+// The next three functions move the elements at the positions in nth, which
+// must be ascending, to where a stable sort would put them. Everything in
+// front of such a position is not greater and everything behind it is not
+// smaller. Only the partitions that hold one of the positions are partitioned
+// further, so a single selection takes O(n) on average. Nth is relative to
+// the original array, base is the position of array in it.
+
+void FUNC(flux_select)(VAR *array, VAR *swap, VAR *ptx, VAR *piv, size_t nmemb, size_t *nth, size_t cnt, size_t base, CMPFUNC *cmp)
+{
+	size_t a_size = 0, s_size, split;
+	int generic = 0;
+
+	while (1)
+	{
+		if (nmemb <= FLUX_OUT)
+		{
+			if (ptx == swap)
+			{
+				memcpy(array, swap, nmemb * sizeof(VAR));
+			}
+			FUNC(quadsort_swap)(array, swap, nmemb, nmemb, cmp);
+			return;
+		}
+		--piv;
+
+		if (nmemb <= 2048)
+		{
+			*piv = FUNC(median_of_nine)(ptx, nmemb, cmp);
+		}
+		else
+		{
+			*piv = FUNC(median_of_cbrt)(array, swap, ptx, nmemb, &generic, cmp);
+
+			if (generic)
+			{
+				if (ptx == swap)
+				{
+					memcpy(array, swap, nmemb * sizeof(VAR));
+				}
+				FUNC(quadsort_swap)(array, swap, nmemb, nmemb, cmp);
+				return;
+			}
+		}
+
+		if (a_size && cmp(piv + 1, piv) <= 0)
+		{
+			a_size = FUNC(flux_reverse_split)(array, swap, array, piv, nmemb, cmp);
+		}
+		else
+		{
+			a_size = FUNC(flux_default_partition)(array, swap, ptx, piv, nmemb, cmp);
+			s_size = nmemb - a_size;
+
+			if (a_size == 0)
+			{
+				return;
+			}
+
+			if (s_size)
+			{
+				for (split = cnt ; split && nth[split - 1] - base >= a_size ; split--) {}
+
+				if (split < cnt)
+				{
+					FUNC(flux_select)(array + a_size, swap, swap, piv, s_size, nth + split, cnt - split, base + a_size, cmp);
+				}
+				else
+				{
+					memcpy(array + a_size, swap, s_size * sizeof(VAR));
+				}
+
+				if (split == 0)
+				{
+					return;
+				}
+				cnt = split;
+				nmemb = a_size;
+				ptx = array;
+				continue;
+			}
+			a_size = FUNC(flux_reverse_split)(array, swap, array, piv, nmemb, cmp);
+		}
+
+		// the elements from a_size on are equal to the pivot, positions there
+		// are done
+
+		while (cnt && nth[cnt - 1] - base >= a_size)
+		{
+			cnt--;
+		}
+
+		if (cnt == 0)
+		{
+			return;
+		}
+		nmemb = a_size;
+		a_size = 0;
+		ptx = array;
+	}
+}
+
+void FUNC(fluxselect_multi)(void *array, size_t nmemb, size_t *nth, size_t cnt, CMPFUNC *cmp)
+{
+	while (cnt && nth[cnt - 1] >= nmemb)
+	{
+		cnt--;
+	}
+
+	if (cnt == 0)
+	{
+		return;
+	}
+
+	if (nmemb <= 132)
+	{
+		FUNC(quadsort)(array, nmemb, cmp);
+	}
+	else
+	{
+		VAR *pta = (VAR *) array;
+		struct flux_alloc *policy = flux_swap_policy;
+		VAR *swap = (VAR *) policy->alloc(nmemb * sizeof(VAR));
+
+		if (swap == NULL)
+		{
+			FUNC(quadsort)(array, nmemb, cmp);
+			return;
+		}
+		FUNC(flux_select)(pta, swap, pta, swap + nmemb, nmemb, nth, cnt, 0, cmp);
+
+		policy->release(swap, nmemb * sizeof(VAR));
+	}
+}
+
+void FUNC(fluxselect)(void *array, size_t nmemb, size_t nth, CMPFUNC *cmp)
+{
+	FUNC(fluxselect_multi)(array, nmemb, &nth, 1, cmp);
+}
+
+// Merges the sorted batch into array, which holds nsorted elements and has
+// room for nbatch more. The batch is placed from the back, a gallop finds how
+// many sorted elements go behind each batch element and that block is moved
+// up at once, so the sorted elements in front of the smallest batch element
+// are never touched. Equal elements keep the sorted elements in front.
+
+void FUNC(flux_insert_merge)(VAR *array, size_t nsorted, VAR *batch, size_t nbatch, CMPFUNC *cmp)
+{
+	VAR *pta = array + nsorted, *ptb = batch + nbatch, *ptd = pta + nbatch;
+	size_t avail, bound, top, mid;
+
+	while (ptb > batch)
+	{
+		--ptb;
+
+		avail = pta - array;
+
+		for (bound = 1 ; bound <= avail && cmp(pta - bound, ptb) > 0 ; bound *= 2) {}
+
+		// between bound / 2 and bound - 1 elements are greater
+
+		mid = bound / 2;
+		top = bound > avail ? avail : bound - 1;
+
+		while (mid < top)
+		{
+			bound = (mid + top + 1) / 2;
+
+			if (cmp(pta - bound, ptb) > 0)
+			{
+				mid = bound;
+			}
+			else
+			{
+				top = bound - 1;
+			}
+		}
+		ptd -= mid;
+		pta -= mid;
+
+		memmove(ptd, pta, mid * sizeof(VAR));
+
+		*--ptd = *ptb;
+
+		if (pta == array)
+		{
+			memcpy(array, batch, (ptb - batch) * sizeof(VAR));
+			return;
+		}
+	}
+}
+
+// The batch is sorted in place with the free room behind the sorted elements
+// as its swap, so no memory is allocated and the work besides moving the
+// sorted elements up scales with the batch. A batch that already fills the
+// free room is moved to a swap and sorted back into the free room, without
+// memory the two runs are merged with rotations.
+
+void FUNC(fluxsort_insert_batch)(void *sorted, size_t nsorted, void *batch, size_t nbatch, CMPFUNC *cmp)
+{
+	VAR *pta = (VAR *) sorted;
+	VAR *ptb = (VAR *) batch;
+
+	if (nbatch == 0)
+	{
+		return;
+	}
+
+	if (ptb == pta + nsorted)
+	{
+		struct flux_alloc *policy = flux_swap_policy;
+		VAR *swap = (VAR *) policy->alloc(nbatch * sizeof(VAR));
+
+		if (swap == NULL)
+		{
+			VAR stack[512];
+
+			FUNC(quadsort_swap)(ptb, stack, 512, nbatch, cmp);
+
+			if (nsorted == 0)
+			{
+				return;
+			}
+
+			if (nbatch <= 512)
+			{
+				FUNC(partial_backward_merge)(pta, stack, 512, nsorted + nbatch, nsorted, cmp);
+			}
+			else if (nsorted <= 512)
+			{
+				FUNC(partial_forward_merge)(pta, stack, 512, nsorted + nbatch, nsorted, cmp);
+			}
+			else
+			{
+				FUNC(rotate_merge_block)(pta, stack, 512, nsorted, nbatch, cmp);
+			}
+			return;
+		}
+		memcpy(swap, ptb, nbatch * sizeof(VAR));
+
+		FUNC(fluxsort_swap)(swap, ptb, nbatch, nbatch, cmp);
+
+		FUNC(flux_insert_merge)(pta, nsorted, swap, nbatch, cmp);
+
+		policy->release(swap, nbatch * sizeof(VAR));
+
+		return;
+	}
+	FUNC(fluxsort_swap)(ptb, pta + nsorted, nbatch, nbatch, cmp);
+
+	FUNC(flux_insert_merge)(pta, nsorted, ptb, nbatch, cmp);
+}
+
+// The next three functions sort and remove duplicates, keeping the first of
+// every run of equal elements, and return the number of unique elements.
+
+size_t FUNC(flux_unique_sorted)(VAR *array, size_t nmemb, CMPFUNC *cmp)
+{
+	VAR *pta, *ptd, *pte;
+	size_t x;
+
+	if (nmemb < 2)
+	{
+		return nmemb;
+	}
+	ptd = array;
+	pte = array + nmemb;
+
+	for (pta = array + 1 ; pta < pte ; pta++)
+	{
+		x = cmp(pta, ptd) > 0; ptd[1] = *pta; ptd += x;
+	}
+	return ptd - array + 1;
+}
+
+// Both partitions are made unique and the right one is moved against the
+// left one. A pivot equal to the previous pivot splits off the elements equal
+// to it, which collapse to the first of them right away, so a low cardinality
+// shrinks while partitioning. Bound is set if piv[1] is the previous pivot.
+
+size_t FUNC(flux_unique)(VAR *array, VAR *swap, VAR *ptx, VAR *piv, size_t nmemb, int bound, CMPFUNC *cmp)
+{
+	size_t a_size, s_size, r_size;
+	int generic = 0;
+	VAR keep;
+
+	if (nmemb <= FLUX_OUT)
+	{
+		if (ptx == swap)
+		{
+			memcpy(array, swap, nmemb * sizeof(VAR));
+		}
+		FUNC(quadsort_swap)(array, swap, nmemb, nmemb, cmp);
+
+		return FUNC(flux_unique_sorted)(array, nmemb, cmp);
+	}
+	--piv;
+
+	if (nmemb <= 2048)
+	{
+		*piv = FUNC(median_of_nine)(ptx, nmemb, cmp);
+	}
+	else
+	{
+		*piv = FUNC(median_of_cbrt)(array, swap, ptx, nmemb, &generic, cmp);
+
+		if (generic)
+		{
+			if (ptx == swap)
+			{
+				memcpy(array, swap, nmemb * sizeof(VAR));
+			}
+			FUNC(quadsort_swap)(array, swap, nmemb, nmemb, cmp);
+
+			return FUNC(flux_unique_sorted)(array, nmemb, cmp);
+		}
+	}
+
+	if (bound && cmp(piv + 1, piv) <= 0)
+	{
+		a_size = FUNC(flux_reverse_split)(array, swap, array, piv, nmemb, cmp);
+	}
+	else
+	{
+		a_size = FUNC(flux_default_partition)(array, swap, ptx, piv, nmemb, cmp);
+		s_size = nmemb - a_size;
+
+		if (a_size == 0)
+		{
+			return FUNC(flux_unique_sorted)(array, nmemb, cmp);
+		}
+
+		if (s_size)
+		{
+			r_size = FUNC(flux_unique)(array + a_size, swap, swap, piv, s_size, 0, cmp);
+			a_size = FUNC(flux_unique)(array, swap, array, piv, a_size, 1, cmp);
+
+			memmove(array + a_size, array + nmemb - s_size, r_size * sizeof(VAR));
+
+			return a_size + r_size;
+		}
+		a_size = FUNC(flux_reverse_split)(array, swap, array, piv, nmemb, cmp);
+	}
+
+	// the elements from a_size on are equal to the pivot
+
+	keep = array[a_size];
+
+	a_size = FUNC(flux_unique)(array, swap, array, piv, a_size, 0, cmp);
+
+	array[a_size] = keep;
+
+	return a_size + 1;
+}
+
+// Mostly ascending or descending data is sorted by flux_analyze() first, the
+// scan that detects it gives up once both directions are common, which for
+// random data is after a few percent of the array.
+
+size_t FUNC(fluxsort_unique)(void *array, size_t nmemb, CMPFUNC *cmp)
+{
+	VAR *pta = (VAR *) array;
+
+	if (nmemb <= 132)
+	{
+		FUNC(quadsort)(array, nmemb, cmp);
+	}
+	else
+	{
+		struct flux_alloc *policy = flux_swap_policy;
+		VAR *swap = (VAR *) policy->alloc(nmemb * sizeof(VAR));
+		VAR *ptx, *pte = pta + nmemb;
+		size_t cnt, asc = 0, desc = 0, limit = nmemb / 64;
+
+		if (swap == NULL)
+		{
+			FUNC(quadsort)(array, nmemb, cmp);
+
+			return FUNC(flux_unique_sorted)(pta, nmemb, cmp);
+		}
+
+		for (ptx = pta + 1 ; ptx < pte ; ptx++)
+		{
+			cnt = cmp(ptx - 1, ptx) > 0; desc += cnt; asc += !cnt;
+
+			if (desc > limit && asc > limit)
+			{
+				break;
+			}
+		}
+
+		if (desc <= limit || asc <= limit)
+		{
+			if (desc)
+			{
+				FUNC(flux_analyze)(pta, swap, nmemb, nmemb, cmp);
+			}
+			cnt = FUNC(flux_unique_sorted)(pta, nmemb, cmp);
+		}
+		else
+		{
+			cnt = FUNC(flux_unique)(pta, swap, pta, swap + nmemb, nmemb, 0, cmp);
+		}
+		policy->release(swap, nmemb * sizeof(VAR));
+
+		return cnt;
+	}
+	return FUNC(flux_unique_sorted)(pta, nmemb, cmp);
+}
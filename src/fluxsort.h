@@ -56,7 +56,9 @@ typedef int CMPFUNC (const void *a, const void *b);
 #define FUNC(NAME) NAME##_int32
 #ifndef cmp
   #define cmp(a,b) (*(a) > *(b))
+  #define FLUX_PRIM
   #include "fluxsort.c"
+  #undef FLUX_PRIM
   #undef cmp
 #else
   #include "fluxsort.c"
@@ -68,7 +70,9 @@ typedef int CMPFUNC (const void *a, const void *b);
 #define FUNC(NAME) NAME##_uint32
 #ifndef cmp
   #define cmp(a,b) (*(a) > *(b))
+  #define FLUX_PRIM
   #include "fluxsort.c"
+  #undef FLUX_PRIM
   #undef cmp
 #else
   #include "fluxsort.c"
@@ -101,7 +105,9 @@ typedef int CMPFUNC (const void *a, const void *b);
 #define FUNC(NAME) NAME##_int64
 #ifndef cmp
   #define cmp(a,b) (*(a) > *(b))
+  #define FLUX_PRIM
   #include "fluxsort.c"
+  #undef FLUX_PRIM
   #undef cmp
 #else
   #include "fluxsort.c"
@@ -113,7 +119,9 @@ typedef int CMPFUNC (const void *a, const void *b);
 #define FUNC(NAME) NAME##_uint64
 #ifndef cmp
   #define cmp(a,b) (*(a) > *(b))
+  #define FLUX_PRIM
   #include "fluxsort.c"
+  #undef FLUX_PRIM
   #undef cmp
 #else
   #include "fluxsort.c"
@@ -121,6 +129,18 @@ typedef int CMPFUNC (const void *a, const void *b);
 #undef VAR
 #undef FUNC
 
+// fluxsort_prim_kv() packed keys and values, see quadsort.h
+
+#ifndef cmp
+  #define VAR unsigned long long
+  #define FUNC(NAME) NAME##_pack64
+  #define cmp(a,b) ((*(a) >> 32) > (*(b) >> 32))
+  #include "fluxsort.c"
+  #undef cmp
+  #undef VAR
+  #undef FUNC
+#endif
+
 // This section is outside of 32/64 bit pointer territory, so no cache checks
 // necessary, unless sorting 32+ byte structures.
 
@@ -186,6 +206,52 @@ typedef int CMPFUNC (const void *a, const void *b);
   #undef FUNC
 #endif
 
+// Records of 12, 16, 24, 32, and 64 bytes, see quadsort.h
+
+#ifndef cmp
+
+#define VAR struct96
+#define FUNC(NAME) NAME##_struct96
+
+#include "fluxsort.c"
+
+#undef VAR
+#undef FUNC
+
+#define VAR struct128
+#define FUNC(NAME) NAME##_struct128
+
+#include "fluxsort.c"
+
+#undef VAR
+#undef FUNC
+
+#define VAR struct192
+#define FUNC(NAME) NAME##_struct192
+
+#include "fluxsort.c"
+
+#undef VAR
+#undef FUNC
+
+#define VAR struct256
+#define FUNC(NAME) NAME##_struct256
+
+#include "fluxsort.c"
+
+#undef VAR
+#undef FUNC
+
+#define VAR struct512
+#define FUNC(NAME) NAME##_struct512
+
+#include "fluxsort.c"
+
+#undef VAR
+#undef FUNC
+
+#endif
+
 //////////////////////////////////////////////////////////////////////////
 //┌────────────────────────────────────────────────────────────────────┐//
 //│███████┐██┐     ██┐   ██┐██┐  ██┐███████┐ ██████┐ ██████┐ ████████┐ │//
@@ -197,6 +263,73 @@ typedef int CMPFUNC (const void *a, const void *b);
 //└────────────────────────────────────────────────────────────────────┘//
 //////////////////////////////////////////////////////////////////////////
 
+// Sort arrays of structures, the comparison function must be by reference.
+// The records are sorted through an array of pointers and then moved in
+// place with quad_permute_size(). The pointers and their swap are placed in
+// swap when swap_bytes allows, so no memory is allocated if swap holds
+// 2 * nmemb pointers.
+
+void fluxsort_size_swap(void *array, void *swap, size_t swap_bytes, size_t nmemb, size_t size, CMPFUNC *cmp)
+{
+	char **pti, *pta;
+	size_t index, offset;
+
+	if (nmemb < 2)
+	{
+		return;
+	}
+	pta = (char *) array;
+
+	if (swap_bytes >= nmemb * sizeof(char *))
+	{
+		pti = (char **) swap;
+		swap_bytes -= nmemb * sizeof(char *);
+	}
+	else
+	{
+		pti = (char **) malloc(nmemb * sizeof(char *));
+		swap_bytes = 0;
+
+		assert(pti != NULL);
+	}
+
+	for (index = offset = 0 ; index < nmemb ; index++)
+	{
+		pti[index] = pta + offset;
+
+		offset += size;
+	}
+
+	if (swap_bytes >= nmemb * sizeof(char *))
+	{
+		switch (sizeof(size_t))
+		{
+			case 4: fluxsort_swap32(pti, pti + nmemb, nmemb, nmemb, cmp); break;
+			case 8: fluxsort_swap64(pti, pti + nmemb, nmemb, nmemb, cmp); break;
+		}
+	}
+	else
+	{
+		switch (sizeof(size_t))
+		{
+			case 4: fluxsort32(pti, nmemb, cmp); break;
+			case 8: fluxsort64(pti, nmemb, cmp); break;
+		}
+	}
+
+	quad_permute_size(pta, pti, nmemb, size);
+
+	if (pti != swap)
+	{
+		free(pti);
+	}
+}
+
+void fluxsort_size(void *array, size_t nmemb, size_t size, CMPFUNC *cmp)
+{
+	fluxsort_size_swap(array, NULL, 0, nmemb, size, cmp);
+}
+
 void fluxsort(void *array, size_t nmemb, size_t size, CMPFUNC *cmp)
 {
 	if (nmemb < 2)
@@ -221,24 +354,62 @@ void fluxsort(void *array, size_t nmemb, size_t size, CMPFUNC *cmp)
 		case sizeof(long long):
 			fluxsort64(array, nmemb, cmp);
 			return;
-#if (DBL_MANT_DIG < LDBL_MANT_DIG)
+#ifndef cmp
+		case sizeof(struct96):
+			fluxsort_struct96(array, nmemb, cmp);
+			return;
+
+		case sizeof(struct128):
+			fluxsort_struct128(array, nmemb, cmp);
+			return;
+
+		case sizeof(struct192):
+			fluxsort_struct192(array, nmemb, cmp);
+			return;
+
+		case sizeof(struct256):
+			fluxsort_struct256(array, nmemb, cmp);
+			return;
+
+		case sizeof(struct512):
+			fluxsort_struct512(array, nmemb, cmp);
+			return;
+
+		default:
+		{
+			CMPFUNC *func = quad_size_func;
+
+			quad_size_func = cmp;
+			fluxsort_size(array, nmemb, size, quad_size_cmp);
+			quad_size_func = func;
+		}
+#else
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
 		case sizeof(long double):
 			fluxsort128(array, nmemb, cmp);
 			return;
-#endif
+  #endif
 
 		default:
-#if (DBL_MANT_DIG < LDBL_MANT_DIG)
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
 			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long) || size == sizeof(long double));
-#else
+  #else
 			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long));
+  #endif
 #endif
 	}
 }
 
-// This must match quadsort_prim()
+// Sorts using at most max_swap_bytes of swap memory. Partitions that don't
+// fit are split in place with rotations. Small budgets fall back to quadsort
+// unless a sample shows few distinct values. The swap comes from
+// flux_swap_policy. The limit applies to the heap only: budgets of 512
+// elements or less, and sorts for which the allocation fails, use a stack
+// buffer of 512 elements whatever the budget. Record sizes without an
+// instantiation are sorted through an array of nmemb pointers, which is
+// allocated on top of the budget, the budget then bounds the pointer swap.
 
-void fluxsort_prim(void *array, size_t nmemb, size_t size)
+void fluxsort_budget(void *array, size_t nmemb, size_t size, CMPFUNC *cmp, size_t max_swap_bytes)
 {
 	if (nmemb < 2)
 	{
@@ -247,65 +418,981 @@ void fluxsort_prim(void *array, size_t nmemb, size_t size)
 
 	switch (size)
 	{
-		case 4:
-			fluxsort_int32(array, nmemb, NULL);
+		case sizeof(char):
+			fluxsort_budget8(array, nmemb, max_swap_bytes / size, cmp);
 			return;
-		case 5:
-			fluxsort_uint32(array, nmemb, NULL);
+
+		case sizeof(short):
+			fluxsort_budget16(array, nmemb, max_swap_bytes / size, cmp);
 			return;
-		case 8:
-			fluxsort_int64(array, nmemb, NULL);
+
+		case sizeof(int):
+			fluxsort_budget32(array, nmemb, max_swap_bytes / size, cmp);
 			return;
-		case 9:
-			fluxsort_uint64(array, nmemb, NULL);
+
+		case sizeof(long long):
+			fluxsort_budget64(array, nmemb, max_swap_bytes / size, cmp);
+			return;
+#ifndef cmp
+		case sizeof(struct96):
+			fluxsort_budget_struct96(array, nmemb, max_swap_bytes / size, cmp);
+			return;
+
+		case sizeof(struct128):
+			fluxsort_budget_struct128(array, nmemb, max_swap_bytes / size, cmp);
 			return;
+
+		case sizeof(struct192):
+			fluxsort_budget_struct192(array, nmemb, max_swap_bytes / size, cmp);
+			return;
+
+		case sizeof(struct256):
+			fluxsort_budget_struct256(array, nmemb, max_swap_bytes / size, cmp);
+			return;
+
+		case sizeof(struct512):
+			fluxsort_budget_struct512(array, nmemb, max_swap_bytes / size, cmp);
+			return;
+
 		default:
-			assert(size == sizeof(int) || size == sizeof(int) + 1 || size == sizeof(long long) || size == sizeof(long long) + 1);
+		{
+			CMPFUNC *func = quad_size_func;
+			char **pti, *pta = (char *) array;
+			size_t index;
+
+			pti = (char **) malloc(nmemb * sizeof(char *));
+
+			assert(pti != NULL);
+
+			for (index = 0 ; index < nmemb ; index++)
+			{
+				pti[index] = pta + index * size;
+			}
+			quad_size_func = cmp;
+
+			switch (sizeof(size_t))
+			{
+				case 4: fluxsort_budget32(pti, nmemb, max_swap_bytes / sizeof(char *), quad_size_cmp); break;
+				case 8: fluxsort_budget64(pti, nmemb, max_swap_bytes / sizeof(char *), quad_size_cmp); break;
+			}
+			quad_size_func = func;
+
+			quad_permute_size(pta, pti, nmemb, size);
+
+			free(pti);
+		}
+#else
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+		case sizeof(long double):
+			fluxsort_budget128(array, nmemb, max_swap_bytes / size, cmp);
 			return;
+  #endif
+
+		default:
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long) || size == sizeof(long double));
+  #else
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long));
+  #endif
+#endif
 	}
 }
 
-// Sort arrays of structures, the comparison function must be by reference.
+#ifndef cmp
 
-void fluxsort_size(void *array, size_t nmemb, size_t size, CMPFUNC *cmp)
+// Merges k runs of records of any size with the loser tree of
+// flux_merge_k_group(), the records are moved with memcpy. Up to FLUX_MERGE_K
+// runs the tree is kept on the stack, for more runs it is allocated. Returns
+// 0 with errno set to ENOMEM if the allocation fails.
+
+size_t flux_merge_k_size_build(char **ptrs, size_t *tree, size_t k, size_t node, CMPFUNC *cmp)
 {
-	char **pti, *pta, *pts;
-	size_t index, offset;
+	size_t lo, hi, x;
 
-	pta = (char *) array;
-	pti = (char **) malloc(nmemb * sizeof(char *));
+	if (node >= k)
+	{
+		return node - k;
+	}
+	lo = flux_merge_k_size_build(ptrs, tree, k, node * 2, cmp);
+	hi = flux_merge_k_size_build(ptrs, tree, k, node * 2 + 1, cmp);
 
-	assert(pti != NULL);
+	if (lo > hi)
+	{
+		x = lo; lo = hi; hi = x;
+	}
+	x = cmp(ptrs[lo], ptrs[hi]) <= 0;
 
-	for (index = offset = 0 ; index < nmemb ; index++)
+	tree[node] = x ? hi : lo;
+
+	return x ? lo : hi;
+}
+
+int flux_merge_k_size(char **runs, size_t *lengths, size_t k, char *dest, size_t size, CMPFUNC *cmp)
+{
+	char *stack_ptrs[FLUX_MERGE_K * 2], **ptrs = stack_ptrs, **ends;
+	size_t stack_tree[FLUX_MERGE_K], *tree = stack_tree, cnt, live, winner, node, lo, hi, x;
+
+	if (k > FLUX_MERGE_K)
 	{
-		pti[index] = pta + offset;
+		ptrs = (char **) malloc(k * 2 * sizeof(char *));
+		tree = (size_t *) malloc(k * sizeof(size_t));
 
-		offset += size;
+		if (ptrs == NULL || tree == NULL)
+		{
+			free(ptrs);
+			free(tree);
+
+			errno = ENOMEM;
+			return 0;
+		}
+	}
+	ends = ptrs + k;
+
+	for (cnt = live = 0 ; cnt < k ; cnt++)
+	{
+		if (lengths[cnt])
+		{
+			ptrs[live] = runs[cnt];
+			ends[live++] = runs[cnt] + lengths[cnt] * size;
+		}
+	}
+
+	while (live > 1)
+	{
+		winner = flux_merge_k_size_build(ptrs, tree, live, 1, cmp);
+
+		while (1)
+		{
+			memcpy(dest, ptrs[winner], size);
+
+			dest += size;
+			ptrs[winner] += size;
+
+			if (ptrs[winner] == ends[winner])
+			{
+				break;
+			}
+
+			for (node = (winner + live) / 2 ; node ; node /= 2)
+			{
+				lo = tree[node] < winner ? tree[node] : winner;
+				hi = tree[node] ^ winner ^ lo;
+
+				x = cmp(ptrs[lo], ptrs[hi]) <= 0;
+
+				tree[node] = x ? hi : lo;
+				winner = x ? lo : hi;
+			}
+		}
+		live--;
+
+		memmove(ptrs + winner, ptrs + winner + 1, (live - winner) * sizeof(char *));
+		memmove(ends + winner, ends + winner + 1, (live - winner) * sizeof(char *));
 	}
 
-	switch (sizeof(size_t))
+	if (live == 1)
 	{
-		case 4: fluxsort32(pti, nmemb, cmp); break;
-		case 8: fluxsort64(pti, nmemb, cmp); break;
+		memcpy(dest, ptrs[0], ends[0] - ptrs[0]);
 	}
 
-	pts = (char *) malloc(nmemb * size);
+	if (k > FLUX_MERGE_K)
+	{
+		free(ptrs);
+		free(tree);
+	}
+	return 1;
+}
 
-	assert(pts != NULL);
-	
-	for (index = 0 ; index < nmemb ; index++)
+#endif
+
+// Merges k sorted runs of lengths[index] elements into dest, which may not
+// overlap the runs. Two runs are merged with twin_merge, more runs pairwise
+// with cross_merge through a swap, or with a loser tree if there is no memory
+// for the swap or the records have no instantiation. Equal elements keep the
+// order of their runs, so merging the sorted blocks of an array is stable.
+// Returns 1, or 0 with errno set to ENOMEM if the records have no
+// instantiation and more than FLUX_MERGE_K runs can't be merged for lack of
+// memory.
+
+int fluxsort_merge_k(void **runs, size_t *lengths, size_t k, void *dest, size_t size, CMPFUNC *cmp)
+{
+	switch (size)
+	{
+		case sizeof(char):
+			fluxsort_merge_k8(runs, lengths, k, dest, cmp);
+			return 1;
+
+		case sizeof(short):
+			fluxsort_merge_k16(runs, lengths, k, dest, cmp);
+			return 1;
+
+		case sizeof(int):
+			fluxsort_merge_k32(runs, lengths, k, dest, cmp);
+			return 1;
+
+		case sizeof(long long):
+			fluxsort_merge_k64(runs, lengths, k, dest, cmp);
+			return 1;
+#ifndef cmp
+		case sizeof(struct96):
+			fluxsort_merge_k_struct96(runs, lengths, k, dest, cmp);
+			return 1;
+
+		case sizeof(struct128):
+			fluxsort_merge_k_struct128(runs, lengths, k, dest, cmp);
+			return 1;
+
+		case sizeof(struct192):
+			fluxsort_merge_k_struct192(runs, lengths, k, dest, cmp);
+			return 1;
+
+		case sizeof(struct256):
+			fluxsort_merge_k_struct256(runs, lengths, k, dest, cmp);
+			return 1;
+
+		case sizeof(struct512):
+			fluxsort_merge_k_struct512(runs, lengths, k, dest, cmp);
+			return 1;
+
+		default:
+			return flux_merge_k_size((char **) runs, lengths, k, (char *) dest, size, cmp);
+#else
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+		case sizeof(long double):
+			fluxsort_merge_k128(runs, lengths, k, dest, cmp);
+			return 1;
+  #endif
+
+		default:
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long) || size == sizeof(long double));
+  #else
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long));
+  #endif
+			return 0;
+#endif
+	}
+}
+
+// Sorts the k smallest elements to the front of the array in the order of a
+// stable sort, the elements past k are left in unspecified order. Records
+// without an instantiation are sorted through pointers like fluxsort_size().
+
+void fluxsort_partial(void *array, size_t nmemb, size_t k, size_t size, CMPFUNC *cmp)
+{
+	if (nmemb < 2 || k == 0)
 	{
-		memcpy(pts, pti[index], size);
+		return;
+	}
+
+	switch (size)
+	{
+		case sizeof(char):
+			fluxsort_partial8(array, nmemb, k, cmp);
+			return;
+
+		case sizeof(short):
+			fluxsort_partial16(array, nmemb, k, cmp);
+			return;
+
+		case sizeof(int):
+			fluxsort_partial32(array, nmemb, k, cmp);
+			return;
+
+		case sizeof(long long):
+			fluxsort_partial64(array, nmemb, k, cmp);
+			return;
+#ifndef cmp
+		case sizeof(struct96):
+			fluxsort_partial_struct96(array, nmemb, k, cmp);
+			return;
+
+		case sizeof(struct128):
+			fluxsort_partial_struct128(array, nmemb, k, cmp);
+			return;
+
+		case sizeof(struct192):
+			fluxsort_partial_struct192(array, nmemb, k, cmp);
+			return;
+
+		case sizeof(struct256):
+			fluxsort_partial_struct256(array, nmemb, k, cmp);
+			return;
+
+		case sizeof(struct512):
+			fluxsort_partial_struct512(array, nmemb, k, cmp);
+			return;
+
+		default:
+		{
+			CMPFUNC *func = quad_size_func;
+			char **pti, *pta = (char *) array;
+			size_t index;
+
+			pti = (char **) malloc(nmemb * sizeof(char *));
+
+			assert(pti != NULL);
+
+			for (index = 0 ; index < nmemb ; index++)
+			{
+				pti[index] = pta + index * size;
+			}
+			quad_size_func = cmp;
+
+			switch (sizeof(size_t))
+			{
+				case 4: fluxsort_partial32(pti, nmemb, k, quad_size_cmp); break;
+				case 8: fluxsort_partial64(pti, nmemb, k, quad_size_cmp); break;
+			}
+			quad_size_func = func;
 
-		pts += size;
+			quad_permute_size(pta, pti, nmemb, size);
+
+			free(pti);
+		}
+#else
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+		case sizeof(long double):
+			fluxsort_partial128(array, nmemb, k, cmp);
+			return;
+  #endif
+
+		default:
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long) || size == sizeof(long double));
+  #else
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long));
+  #endif
+#endif
 	}
-	pts -= nmemb * size;
+}
 
-	memcpy(array, pts, nmemb * size);
+// Moves the elements at the ascending positions in nth to where a stable
+// sort would put them, with the elements in between partitioned around them.
+// Only partitions that hold a position are partitioned further, so several
+// quantiles cost little more than one. Positions past nmemb are ignored.
+
+void fluxselect_multi(void *array, size_t nmemb, size_t *nth, size_t cnt, size_t size, CMPFUNC *cmp)
+{
+	if (nmemb < 2 || cnt == 0)
+	{
+		return;
+	}
 
-	free(pti);
-	free(pts);
+	switch (size)
+	{
+		case sizeof(char):
+			fluxselect_multi8(array, nmemb, nth, cnt, cmp);
+			return;
+
+		case sizeof(short):
+			fluxselect_multi16(array, nmemb, nth, cnt, cmp);
+			return;
+
+		case sizeof(int):
+			fluxselect_multi32(array, nmemb, nth, cnt, cmp);
+			return;
+
+		case sizeof(long long):
+			fluxselect_multi64(array, nmemb, nth, cnt, cmp);
+			return;
+#ifndef cmp
+		case sizeof(struct96):
+			fluxselect_multi_struct96(array, nmemb, nth, cnt, cmp);
+			return;
+
+		case sizeof(struct128):
+			fluxselect_multi_struct128(array, nmemb, nth, cnt, cmp);
+			return;
+
+		case sizeof(struct192):
+			fluxselect_multi_struct192(array, nmemb, nth, cnt, cmp);
+			return;
+
+		case sizeof(struct256):
+			fluxselect_multi_struct256(array, nmemb, nth, cnt, cmp);
+			return;
+
+		case sizeof(struct512):
+			fluxselect_multi_struct512(array, nmemb, nth, cnt, cmp);
+			return;
+
+		default:
+		{
+			CMPFUNC *func = quad_size_func;
+			char **pti, *pta = (char *) array;
+			size_t index;
+
+			pti = (char **) malloc(nmemb * sizeof(char *));
+
+			assert(pti != NULL);
+
+			for (index = 0 ; index < nmemb ; index++)
+			{
+				pti[index] = pta + index * size;
+			}
+			quad_size_func = cmp;
+
+			switch (sizeof(size_t))
+			{
+				case 4: fluxselect_multi32(pti, nmemb, nth, cnt, quad_size_cmp); break;
+				case 8: fluxselect_multi64(pti, nmemb, nth, cnt, quad_size_cmp); break;
+			}
+			quad_size_func = func;
+
+			quad_permute_size(pta, pti, nmemb, size);
+
+			free(pti);
+		}
+#else
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+		case sizeof(long double):
+			fluxselect_multi128(array, nmemb, nth, cnt, cmp);
+			return;
+  #endif
+
+		default:
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long) || size == sizeof(long double));
+  #else
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long));
+  #endif
+#endif
+	}
+}
+
+// Moves the element at position nth to where a stable sort would put it, the
+// elements in front are not greater and the elements behind are not smaller.
+
+void fluxselect(void *array, size_t nmemb, size_t nth, size_t size, CMPFUNC *cmp)
+{
+	fluxselect_multi(array, nmemb, &nth, 1, size, cmp);
+}
+
+#ifndef cmp
+
+// The gallop merge of flux_insert_merge() for records of any size.
+
+void flux_insert_merge_size(char *array, size_t nsorted, char *batch, size_t nbatch, size_t size, CMPFUNC *cmp)
+{
+	char *pta = array + nsorted * size, *ptb = batch + nbatch * size, *ptd = pta + nbatch * size;
+	size_t avail, bound, top, mid;
+
+	while (ptb > batch)
+	{
+		ptb -= size;
+
+		avail = (pta - array) / size;
+
+		for (bound = 1 ; bound <= avail && cmp(pta - bound * size, ptb) > 0 ; bound *= 2) {}
+
+		mid = bound / 2;
+		top = bound > avail ? avail : bound - 1;
+
+		while (mid < top)
+		{
+			bound = (mid + top + 1) / 2;
+
+			if (cmp(pta - bound * size, ptb) > 0)
+			{
+				mid = bound;
+			}
+			else
+			{
+				top = bound - 1;
+			}
+		}
+		ptd -= mid * size;
+		pta -= mid * size;
+
+		memmove(ptd, pta, mid * size);
+
+		ptd -= size;
+
+		memcpy(ptd, ptb, size);
+
+		if (pta == array)
+		{
+			memcpy(array, batch, ptb - batch);
+			return;
+		}
+	}
+}
+
+#endif
+
+// Inserts a batch of unsorted elements into a sorted array, which must have
+// room for nsorted + nbatch elements. The batch is sorted in place and merged
+// in from the back with a gallop, so the cost besides moving the sorted
+// elements behind the smallest batch element scales with the batch. Equal
+// elements keep the sorted elements in front, followed by the batch in order.
+// The batch may not overlap the array, except that it may be appended to it,
+// so batch is sorted + nsorted, in which case a swap of nbatch elements is
+// allocated for the merge. Record sizes without an instantiation are sorted
+// through an array of pointers and its swap, which only fit in the free space
+// if a record is at least two pointers in size.
+
+void fluxsort_insert_batch(void *sorted, size_t nsorted, void *batch, size_t nbatch, size_t size, CMPFUNC *cmp)
+{
+	if (nbatch == 0)
+	{
+		return;
+	}
+
+	switch (size)
+	{
+		case sizeof(char):
+			fluxsort_insert_batch8(sorted, nsorted, batch, nbatch, cmp);
+			return;
+
+		case sizeof(short):
+			fluxsort_insert_batch16(sorted, nsorted, batch, nbatch, cmp);
+			return;
+
+		case sizeof(int):
+			fluxsort_insert_batch32(sorted, nsorted, batch, nbatch, cmp);
+			return;
+
+		case sizeof(long long):
+			fluxsort_insert_batch64(sorted, nsorted, batch, nbatch, cmp);
+			return;
+#ifndef cmp
+		case sizeof(struct96):
+			fluxsort_insert_batch_struct96(sorted, nsorted, batch, nbatch, cmp);
+			return;
+
+		case sizeof(struct128):
+			fluxsort_insert_batch_struct128(sorted, nsorted, batch, nbatch, cmp);
+			return;
+
+		case sizeof(struct192):
+			fluxsort_insert_batch_struct192(sorted, nsorted, batch, nbatch, cmp);
+			return;
+
+		case sizeof(struct256):
+			fluxsort_insert_batch_struct256(sorted, nsorted, batch, nbatch, cmp);
+			return;
+
+		case sizeof(struct512):
+			fluxsort_insert_batch_struct512(sorted, nsorted, batch, nbatch, cmp);
+			return;
+
+		default:
+		{
+			struct flux_alloc *policy = flux_swap_policy;
+			CMPFUNC *func = quad_size_func;
+			char *room = (char *) sorted + nsorted * size, *ptb = (char *) batch;
+
+			if (ptb == room)
+			{
+				ptb = (char *) policy->alloc(nbatch * size);
+
+				if (ptb == NULL)
+				{
+					fluxsort(sorted, nsorted + nbatch, size, cmp);
+					return;
+				}
+				memcpy(ptb, batch, nbatch * size);
+			}
+			quad_size_func = cmp;
+			fluxsort_size_swap(ptb, room, nbatch * size, nbatch, size, quad_size_cmp);
+			quad_size_func = func;
+
+			flux_insert_merge_size((char *) sorted, nsorted, ptb, nbatch, size, cmp);
+
+			if (ptb != batch)
+			{
+				policy->release(ptb, nbatch * size);
+			}
+		}
+#else
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+		case sizeof(long double):
+			fluxsort_insert_batch128(sorted, nsorted, batch, nbatch, cmp);
+			return;
+  #endif
+
+		default:
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long) || size == sizeof(long double));
+  #else
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long));
+  #endif
+#endif
+	}
+}
+
+// Sorts the array and removes duplicates, keeping the first of every run of
+// equal elements, and returns the number of elements left. Elements equal to
+// a pivot are collapsed while partitioning, so data with few distinct values
+// shrinks before most of the work is done.
+
+size_t fluxsort_unique(void *array, size_t nmemb, size_t size, CMPFUNC *cmp)
+{
+	if (nmemb < 2)
+	{
+		return nmemb;
+	}
+
+	switch (size)
+	{
+		case sizeof(char):
+			return fluxsort_unique8(array, nmemb, cmp);
+
+		case sizeof(short):
+			return fluxsort_unique16(array, nmemb, cmp);
+
+		case sizeof(int):
+			return fluxsort_unique32(array, nmemb, cmp);
+
+		case sizeof(long long):
+			return fluxsort_unique64(array, nmemb, cmp);
+#ifndef cmp
+		case sizeof(struct96):
+			return fluxsort_unique_struct96(array, nmemb, cmp);
+
+		case sizeof(struct128):
+			return fluxsort_unique_struct128(array, nmemb, cmp);
+
+		case sizeof(struct192):
+			return fluxsort_unique_struct192(array, nmemb, cmp);
+
+		case sizeof(struct256):
+			return fluxsort_unique_struct256(array, nmemb, cmp);
+
+		case sizeof(struct512):
+			return fluxsort_unique_struct512(array, nmemb, cmp);
+
+		default:
+		{
+			char *pta, *ptd, *pte;
+
+			fluxsort(array, nmemb, size, cmp);
+
+			ptd = (char *) array;
+			pte = ptd + nmemb * size;
+
+			for (pta = ptd + size ; pta < pte ; pta += size)
+			{
+				if (cmp(pta, ptd) > 0)
+				{
+					ptd += size;
+					memcpy(ptd, pta, size);
+				}
+			}
+			return (ptd - (char *) array) / size + 1;
+		}
+#else
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+		case sizeof(long double):
+			return fluxsort_unique128(array, nmemb, cmp);
+  #endif
+
+		default:
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long) || size == sizeof(long double));
+  #else
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long));
+  #endif
+			return nmemb;
+#endif
+	}
+}
+
+// This must match quadsort_prim()
+
+void fluxsort_prim(void *array, size_t nmemb, size_t size)
+{
+	if (nmemb < 2)
+	{
+		return;
+	}
+
+	switch (size)
+	{
+		case 0:
+			flux_count8((unsigned char *) array, nmemb, 0);
+			return;
+		case 1:
+			flux_count8((unsigned char *) array, nmemb, 0x80);
+			return;
+		case 2:
+			if (flux_count16((unsigned short *) array, nmemb, 0x8000) == 0)
+			{
+				fluxsort16(array, nmemb, flux_cmp_int16);
+			}
+			return;
+		case 3:
+			if (flux_count16((unsigned short *) array, nmemb, 0) == 0)
+			{
+				fluxsort16(array, nmemb, flux_cmp_uint16);
+			}
+			return;
+		case 4:
+			fluxsort_int32(array, nmemb, NULL);
+			return;
+		case 5:
+			fluxsort_uint32(array, nmemb, NULL);
+			return;
+		case 6:
+			prim_float_keys((unsigned int *) array, nmemb);
+			fluxsort_uint32(array, nmemb, NULL);
+			prim_float_bits((unsigned int *) array, nmemb);
+			return;
+		case 7:
+			prim_double_keys((unsigned long long *) array, nmemb);
+			fluxsort_uint64(array, nmemb, NULL);
+			prim_double_bits((unsigned long long *) array, nmemb);
+			return;
+		case 8:
+			fluxsort_int64(array, nmemb, NULL);
+			return;
+		case 9:
+			fluxsort_uint64(array, nmemb, NULL);
+			return;
+		default:
+			assert(size <= 9);
+			return;
+	}
+}
+
+#ifndef cmp
+
+// Sorts the packed records of fluxsort_kv() with the larger of the key and
+// value arrays as swap. The records are sorted by value, with the in place
+// splits of fluxsort_budget() where a partition doesn't fit in the swap.
+
+void flux_kv_sort(char *array, char *swap, size_t swap_bytes, size_t nmemb, size_t size, CMPFUNC *cmp)
+{
+	switch (size)
+	{
+		case sizeof(char):
+			fluxsort_budget_swap8(array, swap, swap_bytes / size, nmemb, cmp);
+			return;
+
+		case sizeof(short):
+			fluxsort_budget_swap16(array, swap, swap_bytes / size, nmemb, cmp);
+			return;
+
+		case sizeof(int):
+			fluxsort_budget_swap32(array, swap, swap_bytes / size, nmemb, cmp);
+			return;
+
+		case sizeof(long long):
+			fluxsort_budget_swap64(array, swap, swap_bytes / size, nmemb, cmp);
+			return;
+
+		case sizeof(struct96):
+			fluxsort_budget_swap_struct96(array, swap, swap_bytes / size, nmemb, cmp);
+			return;
+
+		case sizeof(struct128):
+			fluxsort_budget_swap_struct128(array, swap, swap_bytes / size, nmemb, cmp);
+			return;
+
+		case sizeof(struct192):
+			fluxsort_budget_swap_struct192(array, swap, swap_bytes / size, nmemb, cmp);
+			return;
+
+		case sizeof(struct256):
+			fluxsort_budget_swap_struct256(array, swap, swap_bytes / size, nmemb, cmp);
+			return;
+
+		case sizeof(struct512):
+			fluxsort_budget_swap_struct512(array, swap, swap_bytes / size, nmemb, cmp);
+			return;
+
+		default:
+		{
+			CMPFUNC *func = quad_size_func;
+
+			quad_size_func = cmp;
+			fluxsort_size_swap(array, swap, swap_bytes, nmemb, size, quad_size_cmp);
+			quad_size_func = func;
+		}
+	}
+}
+
+// Sorts keys and moves a value of value_size bytes along with each key. Each
+// key and value are packed in a record, padded to the nearest record size that
+// is sorted by value, so the values move in lockstep with the keys. The record
+// size is a multiple of the alignment of the key, so the comparison function,
+// which is by reference and gets a pointer to the key, can load the key
+// directly. Packing and unpacking cost a pass each, and the records take a
+// buffer of nmemb records. Once packed, the larger of the key and value arrays
+// is reused as swap, so no further memory is allocated if it is aligned to the
+// record size, or to a pointer for larger records.
+
+void fluxsort_kv(void *keys, void *values, size_t nmemb, size_t key_size, size_t value_size, CMPFUNC *cmp)
+{
+	static const size_t sizes[] = { 1, 2, 4, 8, 12, 16, 24, 32, 64 };
+	char *pta, *pts, *ptk = (char *) keys, *ptv = (char *) values;
+	size_t size, align, index, cnt, swap_bytes;
+
+	if (nmemb < 2)
+	{
+		return;
+	}
+	size = key_size + value_size;
+	align = key_size & -key_size;
+
+	for (cnt = 0 ; cnt < sizeof(sizes) / sizeof(size_t) ; cnt++)
+	{
+		if (size <= sizes[cnt] && sizes[cnt] % align == 0)
+		{
+			size = sizes[cnt];
+			break;
+		}
+	}
+	size = (size + align - 1) / align * align;
+	pta = (char *) malloc(nmemb * size);
+
+	assert(pta != NULL);
+
+	for (index = 0 ; index < nmemb ; index++)
+	{
+		memcpy(pta + index * size, ptk + index * key_size, key_size);
+		memcpy(pta + index * size + key_size, ptv + index * value_size, value_size);
+	}
+
+	pts = key_size >= value_size ? ptk : ptv;
+	swap_bytes = nmemb * (key_size >= value_size ? key_size : value_size);
+	align = size < sizeof(char *) ? size : sizeof(char *);
+
+	if ((size_t) pts % align == 0)
+	{
+		flux_kv_sort(pta, pts, swap_bytes, nmemb, size, cmp);
+	}
+	else
+	{
+		fluxsort(pta, nmemb, size, cmp);
+	}
+
+	for (index = 0 ; index < nmemb ; index++)
+	{
+		memcpy(ptk + index * key_size, pta + index * size, key_size);
+		memcpy(ptv + index * value_size, pta + index * size + key_size, value_size);
+	}
+	free(pta);
+}
+
+// 32 bit keys with 32 bit values are packed in one 64 bit element, the key in
+// the upper half with its sign bit flipped, so no record padding is needed and
+// only the keys are compared.
+
+void flux_pack_kv32(unsigned int *keys, unsigned int *values, size_t nmemb, unsigned int flip)
+{
+	unsigned long long *pta;
+	size_t index;
+
+	pta = (unsigned long long *) malloc(nmemb * sizeof(unsigned long long));
+
+	assert(pta != NULL);
+
+	for (index = 0 ; index < nmemb ; index++)
+	{
+		pta[index] = (unsigned long long) (keys[index] ^ flip) << 32 | values[index];
+	}
+
+	fluxsort_pack64(pta, nmemb, NULL);
+
+	for (index = 0 ; index < nmemb ; index++)
+	{
+		keys[index] = (unsigned int) (pta[index] >> 32) ^ flip;
+		values[index] = (unsigned int) pta[index];
+	}
+	free(pta);
+}
+
+int flux_cmp_int32(const void *a, const void *b)
+{
+	const int x = *(const int *) a, y = *(const int *) b;
+
+	return (x > y) - (x < y);
+}
+
+int flux_cmp_uint32(const void *a, const void *b)
+{
+	const unsigned int x = *(const unsigned int *) a, y = *(const unsigned int *) b;
+
+	return (x > y) - (x < y);
+}
+
+int flux_cmp_int64(const void *a, const void *b)
+{
+	const long long x = *(const long long *) a, y = *(const long long *) b;
+
+	return (x > y) - (x < y);
+}
+
+int flux_cmp_uint64(const void *a, const void *b)
+{
+	const unsigned long long x = *(const unsigned long long *) a, y = *(const unsigned long long *) b;
+
+	return (x > y) - (x < y);
+}
+
+#endif
+
+// Stable sort of primitive keys that moves a value of value_size bytes along
+// with each key. 8 and 16 bit keys, size codes 0 to 3, are counted. 32 and 64
+// bit keys, size codes 4, 5, 8, and 9, are sorted with fluxsort_kv(), 32 bit
+// keys with 32 bit values are packed in 64 bit elements. Only size codes 0 to
+// 3 are available when the cmp macro is defined.
+
+void fluxsort_prim_kv(void *keys, void *values, size_t nmemb, size_t size, size_t value_size)
+{
+	if (nmemb < 2)
+	{
+		return;
+	}
+
+	switch (size)
+	{
+		case 0:
+			flux_count_kv8((unsigned char *) keys, (char *) values, nmemb, value_size, 0);
+			return;
+		case 1:
+			flux_count_kv8((unsigned char *) keys, (char *) values, nmemb, value_size, 0x80);
+			return;
+		case 2:
+			flux_count_kv16((unsigned short *) keys, (char *) values, nmemb, value_size, 0x8000);
+			return;
+		case 3:
+			flux_count_kv16((unsigned short *) keys, (char *) values, nmemb, value_size, 0);
+			return;
+#ifndef cmp
+		case 4:
+			if (value_size == sizeof(int))
+			{
+				flux_pack_kv32((unsigned int *) keys, (unsigned int *) values, nmemb, 0x80000000U);
+				return;
+			}
+			fluxsort_kv(keys, values, nmemb, sizeof(int), value_size, flux_cmp_int32);
+			return;
+		case 5:
+			if (value_size == sizeof(int))
+			{
+				flux_pack_kv32((unsigned int *) keys, (unsigned int *) values, nmemb, 0);
+				return;
+			}
+			fluxsort_kv(keys, values, nmemb, sizeof(int), value_size, flux_cmp_uint32);
+			return;
+		case 8:
+			fluxsort_kv(keys, values, nmemb, sizeof(long long), value_size, flux_cmp_int64);
+			return;
+		case 9:
+			fluxsort_kv(keys, values, nmemb, sizeof(long long), value_size, flux_cmp_uint64);
+			return;
+		default:
+			assert(size <= 5 || size == 8 || size == 9);
+			return;
+#else
+		default:
+			assert(size <= 3);
+			return;
+#endif
+	}
 }
 
 #undef QUAD_CACHE
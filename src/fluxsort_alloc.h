@@ -0,0 +1,227 @@
+// fluxsort_alloc 1.2.1.3 - Igor van den Hoven ivdhoven@gmail.com
+
+// Allocation policies for the swap memory of fluxsort() and quadsort(). A
+// fresh malloc of tens of megabytes is lazily mapped, so the first pass over
+// the swap takes a page fault every 4 KB and the 4 KB pages cost a lot of TLB
+// misses. The policies below map large swaps with transparent huge pages,
+// pre-fault them with MAP_POPULATE, or reuse a pinned region that stays
+// mapped between sorts.
+
+// flux_alloc_policy() sets the policy, which should be done before sorting.
+// A sort reads the policy once, so the swap is always freed by the policy
+// that allocated it.
+
+#ifndef FLUXSORT_ALLOC_H
+#define FLUXSORT_ALLOC_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined __linux__
+  #include <sys/mman.h>
+#endif
+
+// Swaps smaller than FLUX_ALLOC_MMAP are left to malloc, mapping them
+// doesn't pay off. FLUX_ALLOC_HUGE is the size of a transparent huge page.
+
+#define FLUX_ALLOC_MMAP 4194304
+#define FLUX_ALLOC_HUGE 2097152
+
+typedef void *FLUXALLOC (size_t bytes);
+typedef void FLUXFREE (void *swap, size_t bytes);
+
+struct flux_alloc
+{
+	FLUXALLOC *alloc;
+	FLUXFREE *release;
+};
+
+void *flux_alloc_malloc(size_t bytes)
+{
+	return malloc(bytes);
+}
+
+void flux_free_malloc(void *swap, size_t bytes)
+{
+	free(swap);
+}
+
+#if defined __linux__
+
+// The mapping is rounded up to a multiple of FLUX_ALLOC_HUGE and aligned by
+// mapping one extra huge page and unmapping the excess on both ends.
+
+void *flux_alloc_hugepage(size_t bytes)
+{
+	size_t size, head;
+	char *map;
+
+	if (bytes < FLUX_ALLOC_MMAP)
+	{
+		return malloc(bytes);
+	}
+	size = (bytes + FLUX_ALLOC_HUGE - 1) / FLUX_ALLOC_HUGE * FLUX_ALLOC_HUGE;
+
+	map = (char *) mmap(NULL, size + FLUX_ALLOC_HUGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (map == (char *) MAP_FAILED)
+	{
+		return NULL;
+	}
+	head = FLUX_ALLOC_HUGE - (size_t) map % FLUX_ALLOC_HUGE;
+
+	if (head < FLUX_ALLOC_HUGE)
+	{
+		munmap(map, head);
+	}
+	else
+	{
+		head = 0;
+	}
+	munmap(map + head + size, FLUX_ALLOC_HUGE - head);
+
+#ifdef MADV_HUGEPAGE
+	madvise(map + head, size, MADV_HUGEPAGE);
+#endif
+	return map + head;
+}
+
+void flux_free_hugepage(void *swap, size_t bytes)
+{
+	if (bytes < FLUX_ALLOC_MMAP)
+	{
+		free(swap);
+		return;
+	}
+	munmap(swap, (bytes + FLUX_ALLOC_HUGE - 1) / FLUX_ALLOC_HUGE * FLUX_ALLOC_HUGE);
+}
+
+// Faults in every page up front, which is cheaper than faulting them one at
+// a time during the first partition.
+
+void *flux_alloc_populate(size_t bytes)
+{
+	void *map;
+
+	if (bytes < FLUX_ALLOC_MMAP)
+	{
+		return malloc(bytes);
+	}
+#ifdef MAP_POPULATE
+	map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+#else
+	map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#endif
+	return map == MAP_FAILED ? NULL : map;
+}
+
+void flux_free_populate(void *swap, size_t bytes)
+{
+	if (bytes < FLUX_ALLOC_MMAP)
+	{
+		free(swap);
+		return;
+	}
+	munmap(swap, bytes);
+}
+
+#else
+
+#define flux_alloc_hugepage flux_alloc_malloc
+#define flux_free_hugepage flux_free_malloc
+#define flux_alloc_populate flux_alloc_malloc
+#define flux_free_populate flux_free_malloc
+
+#endif
+
+// The pinned region is set up by flux_alloc_pin() and handed to one sort at a
+// time, a sort that finds it busy or too small uses malloc.
+
+void *flux_pin_region;
+size_t flux_pin_size;
+int flux_pin_busy;
+
+void *flux_alloc_pinned(size_t bytes)
+{
+	if (bytes <= flux_pin_size && __sync_bool_compare_and_swap(&flux_pin_busy, 0, 1))
+	{
+		return flux_pin_region;
+	}
+	return malloc(bytes);
+}
+
+void flux_free_pinned(void *swap, size_t bytes)
+{
+	if (swap == flux_pin_region)
+	{
+		__sync_lock_release(&flux_pin_busy);
+		return;
+	}
+	free(swap);
+}
+
+struct flux_alloc flux_policy_malloc = { flux_alloc_malloc, flux_free_malloc };
+struct flux_alloc flux_policy_hugepage = { flux_alloc_hugepage, flux_free_hugepage };
+struct flux_alloc flux_policy_populate = { flux_alloc_populate, flux_free_populate };
+struct flux_alloc flux_policy_pinned = { flux_alloc_pinned, flux_free_pinned };
+
+struct flux_alloc *flux_swap_policy = &flux_policy_malloc;
+
+// Passing NULL restores malloc. A custom policy must stay valid while sorts
+// that picked it up are running.
+
+void flux_alloc_policy(struct flux_alloc *policy)
+{
+	flux_swap_policy = policy ? policy : &flux_policy_malloc;
+}
+
+// Frees the pinned region. Must not be called while a sort uses the region.
+
+void flux_alloc_unpin(void)
+{
+	if (flux_pin_region)
+	{
+		flux_free_hugepage(flux_pin_region, flux_pin_size);
+	}
+	flux_pin_region = NULL;
+	flux_pin_size = 0;
+}
+
+// Makes sure the pinned region holds at least bytes, returns 0 if memory is
+// short. The region is mapped with huge pages on Linux, pre-faulted, and
+// locked in memory if the process is allowed to. Must not be called while a
+// sort uses the region.
+
+int flux_alloc_pin(size_t bytes)
+{
+	void *region;
+
+	if (bytes <= flux_pin_size)
+	{
+		return 1;
+	}
+
+	if (bytes < FLUX_ALLOC_MMAP)
+	{
+		bytes = FLUX_ALLOC_MMAP;
+	}
+	region = flux_alloc_hugepage(bytes);
+
+	if (region == NULL)
+	{
+		return 0;
+	}
+	memset(region, 0, bytes);
+
+#if defined __linux__
+	mlock(region, bytes);
+#endif
+	flux_alloc_unpin();
+
+	flux_pin_region = region;
+	flux_pin_size = bytes;
+
+	return 1;
+}
+
+#endif
@@ -0,0 +1,231 @@
+// fluxsort_arg 1.2.1.3 - Igor van den Hoven ivdhoven@gmail.com
+
+// Argsort returns the permutation that sorts an array of keys, without moving
+// the keys. An array of 32 bit indices is sorted by fluxsort with every
+// comparison looking up the keys, which is half the memory traffic of sorting
+// 64 bit pointers. The sort is stable, equal keys keep their index order.
+
+#ifndef FLUXSORT_ARG_H
+#define FLUXSORT_ARG_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+#include <float.h>
+#include <string.h>
+#include <stdint.h>
+
+typedef int CMPFUNC (const void *a, const void *b);
+
+//#define cmp(a,b) (*(a) > *(b))
+
+#ifndef FLUXSORT_H
+  #include "fluxsort.h"
+#endif
+
+// The index sorts compare keys instead of indices, which the cmp macro would
+// override, so argsort is left out when it is defined.
+
+#ifndef cmp
+
+// The keys are looked up through thread local pointers, so the comparison
+// function keeps the CMPFUNC signature and the sorts can run in parallel.
+
+__thread const char *flux_arg_keys;
+__thread size_t flux_arg_size;
+__thread CMPFUNC *flux_arg_func;
+
+int flux_arg_cmp32(const void *a, const void *b)
+{
+	return flux_arg_func(flux_arg_keys + *(const uint32_t *) a * flux_arg_size, flux_arg_keys + *(const uint32_t *) b * flux_arg_size);
+}
+
+int flux_arg_cmp64(const void *a, const void *b)
+{
+	return flux_arg_func(flux_arg_keys + *(const uint64_t *) a * flux_arg_size, flux_arg_keys + *(const uint64_t *) b * flux_arg_size);
+}
+
+// Primitive keys of 64 bit indices are compared by these functions.
+
+#define FLUX_ARG_CMP(NAME, TYPE)  \
+int NAME(const void *a, const void *b)  \
+{  \
+	TYPE x = ((const TYPE *) flux_arg_keys)[*(const uint64_t *) a];  \
+	TYPE y = ((const TYPE *) flux_arg_keys)[*(const uint64_t *) b];  \
+  \
+	return (x > y) - (x < y);  \
+}
+
+FLUX_ARG_CMP(flux_arg_cmp_int32, int)
+FLUX_ARG_CMP(flux_arg_cmp_uint32, unsigned int)
+FLUX_ARG_CMP(flux_arg_cmp_int64, long long)
+FLUX_ARG_CMP(flux_arg_cmp_uint64, unsigned long long)
+
+#undef FLUX_ARG_CMP
+
+// Primitive keys of 32 bit indices are compared inline by instantiating the
+// sorts with a cmp macro that looks up the keys.
+
+#define QUAD_CACHE 262144
+
+#define VAR uint32_t
+#define FUNC(NAME) NAME##_arg_int32
+#define cmp(a,b) (((const int *) flux_arg_keys)[*(a)] > ((const int *) flux_arg_keys)[*(b)])
+  #include "quadsort.c"
+  #include "fluxsort.c"
+#undef cmp
+#undef VAR
+#undef FUNC
+
+#define VAR uint32_t
+#define FUNC(NAME) NAME##_arg_uint32
+#define cmp(a,b) (((const unsigned int *) flux_arg_keys)[*(a)] > ((const unsigned int *) flux_arg_keys)[*(b)])
+  #include "quadsort.c"
+  #include "fluxsort.c"
+#undef cmp
+#undef VAR
+#undef FUNC
+
+#define VAR uint32_t
+#define FUNC(NAME) NAME##_arg_int64
+#define cmp(a,b) (((const long long *) flux_arg_keys)[*(a)] > ((const long long *) flux_arg_keys)[*(b)])
+  #include "quadsort.c"
+  #include "fluxsort.c"
+#undef cmp
+#undef VAR
+#undef FUNC
+
+#define VAR uint32_t
+#define FUNC(NAME) NAME##_arg_uint64
+#define cmp(a,b) (((const unsigned long long *) flux_arg_keys)[*(a)] > ((const unsigned long long *) flux_arg_keys)[*(b)])
+  #include "quadsort.c"
+  #include "fluxsort.c"
+#undef cmp
+#undef VAR
+#undef FUNC
+
+#undef QUAD_CACHE
+
+//////////////////////////////////////////////////////////////////////////
+//┌────────────────────────────────────────────────────────────────────┐//
+//│███████┐██┐     ██┐   ██┐██┐  ██┐███████┐ ██████┐ ██████┐ ████████┐ │//
+//│██┌────┘██│     ██│   ██│└██┐██┌┘██┌────┘██┌───██┐██┌──██┐└──██┌──┘ │//
+//│█████┐  ██│     ██│   ██│ └███┌┘ ███████┐██│   ██│██████┌┘   ██│    │//
+//│██┌──┘  ██│     ██│   ██│ ██┌██┐ └────██│██│   ██│██┌──██┐   ██│    │//
+//│██│     ███████┐└██████┌┘██┌┘ ██┐███████│└██████┌┘██│  ██│   ██│    │//
+//│└─┘     └──────┘ └─────┘ └─┘  └─┘└──────┘ └─────┘ └─┘  └─┘   └─┘    │//
+//└────────────────────────────────────────────────────────────────────┘//
+//////////////////////////////////////////////////////////////////////////
+
+// Stores the permutation that sorts keys in perm, keys[perm[0]] is the
+// smallest key. The comparison function is by reference, like fluxsort().
+// If cmp is NULL the keys are primitives and size is a size code of
+// fluxsort_prim(), 4 and 5 for signed and unsigned int, 8 and 9 for signed
+// and unsigned long long. Nmemb must fit in 32 bits.
+
+void fluxsort_argsort(const void *keys, size_t nmemb, size_t size, CMPFUNC *cmp, uint32_t *perm)
+{
+	const char *prev_keys = flux_arg_keys;
+	size_t prev_size = flux_arg_size;
+	CMPFUNC *prev_func = flux_arg_func;
+	size_t index;
+
+	assert(nmemb <= UINT32_MAX);
+
+	for (index = 0 ; index < nmemb ; index++)
+	{
+		perm[index] = index;
+	}
+
+	if (nmemb < 2)
+	{
+		return;
+	}
+	flux_arg_keys = (const char *) keys;
+	flux_arg_size = size;
+	flux_arg_func = cmp;
+
+	if (cmp)
+	{
+		fluxsort32(perm, nmemb, flux_arg_cmp32);
+	}
+	else
+	{
+		switch (size)
+		{
+			case 4:
+				fluxsort_arg_int32(perm, nmemb, NULL);
+				break;
+			case 5:
+				fluxsort_arg_uint32(perm, nmemb, NULL);
+				break;
+			case 8:
+				fluxsort_arg_int64(perm, nmemb, NULL);
+				break;
+			case 9:
+				fluxsort_arg_uint64(perm, nmemb, NULL);
+				break;
+			default:
+				assert(size == 4 || size == 5 || size == 8 || size == 9);
+		}
+	}
+	flux_arg_keys = prev_keys;
+	flux_arg_size = prev_size;
+	flux_arg_func = prev_func;
+}
+
+// Like fluxsort_argsort() for arrays too large for 32 bit indices.
+
+void fluxsort_argsort64(const void *keys, size_t nmemb, size_t size, CMPFUNC *cmp, uint64_t *perm)
+{
+	const char *prev_keys = flux_arg_keys;
+	size_t prev_size = flux_arg_size;
+	CMPFUNC *prev_func = flux_arg_func;
+	size_t index;
+
+	for (index = 0 ; index < nmemb ; index++)
+	{
+		perm[index] = index;
+	}
+
+	if (nmemb < 2)
+	{
+		return;
+	}
+	flux_arg_keys = (const char *) keys;
+	flux_arg_size = size;
+	flux_arg_func = cmp;
+
+	if (cmp)
+	{
+		fluxsort64(perm, nmemb, flux_arg_cmp64);
+	}
+	else
+	{
+		switch (size)
+		{
+			case 4:
+				fluxsort64(perm, nmemb, flux_arg_cmp_int32);
+				break;
+			case 5:
+				fluxsort64(perm, nmemb, flux_arg_cmp_uint32);
+				break;
+			case 8:
+				fluxsort64(perm, nmemb, flux_arg_cmp_int64);
+				break;
+			case 9:
+				fluxsort64(perm, nmemb, flux_arg_cmp_uint64);
+				break;
+			default:
+				assert(size == 4 || size == 5 || size == 8 || size == 9);
+		}
+	}
+	flux_arg_keys = prev_keys;
+	flux_arg_size = prev_size;
+	flux_arg_func = prev_func;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,181 @@
+// fluxsort_count 1.2.1.3 - Igor van den Hoven ivdhoven@gmail.com
+
+// Counting sort for the 8 and 16 bit size codes of fluxsort_prim() and
+// quadsort_prim(). There are only 256 or 65536 possible values, so a
+// histogram followed by a prefix sum sorts the array in two linear passes.
+// Signed keys are xor'ed with the sign bit so the negative values are
+// counted in front of the positive ones.
+
+#ifndef FLUXSORT_COUNT_H
+#define FLUXSORT_COUNT_H
+
+// 16 bit keys are counted in 65536 buckets, which doesn't pay off for small
+// arrays, these are left to the comparison sorts.
+
+#define FLUX_COUNT16_MIN 1024
+
+// Four interleaved histograms avoid stalling on the same counter when there
+// are long stretches of equal keys, which is common for flag columns.
+
+void flux_count8(unsigned char *array, size_t nmemb, unsigned char flip)
+{
+	size_t count[4][256], index, cnt;
+	unsigned char *pta = array;
+
+	memset(count, 0, sizeof(count));
+
+	for (index = nmemb / 4 ; index ; index--)
+	{
+		count[0][pta[0]]++;
+		count[1][pta[1]]++;
+		count[2][pta[2]]++;
+		count[3][pta[3]]++;
+
+		pta += 4;
+	}
+
+	for (index = nmemb % 4 ; index ; index--)
+	{
+		count[0][*pta++]++;
+	}
+
+	for (index = 0 ; index < 256 ; index++)
+	{
+		cnt = count[0][index ^ flip] + count[1][index ^ flip] + count[2][index ^ flip] + count[3][index ^ flip];
+
+		memset(array, index ^ flip, cnt);
+
+		array += cnt;
+	}
+}
+
+// Returns 0 if the array is too small or memory is short, in which case the
+// caller should sort the array.
+
+int flux_count16(unsigned short *array, size_t nmemb, unsigned short flip)
+{
+	size_t *count, index, cnt;
+	unsigned short key;
+
+	if (nmemb < FLUX_COUNT16_MIN)
+	{
+		return 0;
+	}
+
+	count = (size_t *) calloc(65536, sizeof(size_t));
+
+	if (count == NULL)
+	{
+		return 0;
+	}
+
+	for (index = 0 ; index < nmemb ; index++)
+	{
+		count[array[index]]++;
+	}
+
+	for (index = 0 ; index < 65536 ; index++)
+	{
+		key = (unsigned short) (index ^ flip);
+
+		for (cnt = count[key] ; cnt ; cnt--)
+		{
+			*array++ = key;
+		}
+	}
+	free(count);
+
+	return 1;
+}
+
+// Stable counting sort that moves a value of value_size bytes along with
+// each key. The keys and values are scattered to a scratch buffer using the
+// prefix sums and copied back.
+
+void flux_count_kv8(unsigned char *keys, char *values, size_t nmemb, size_t value_size, unsigned char flip)
+{
+	size_t count[256], index, sum, cnt;
+	unsigned char *swap_keys;
+	char *swap_values;
+
+	swap_keys = (unsigned char *) malloc(nmemb * (value_size + 1));
+
+	assert(swap_keys != NULL);
+
+	swap_values = (char *) swap_keys + nmemb;
+
+	memset(count, 0, sizeof(count));
+
+	for (index = 0 ; index < nmemb ; index++)
+	{
+		count[keys[index] ^ flip]++;
+	}
+
+	for (index = sum = 0 ; index < 256 ; index++)
+	{
+		cnt = count[index]; count[index] = sum; sum += cnt;
+	}
+
+	for (index = 0 ; index < nmemb ; index++)
+	{
+		cnt = count[keys[index] ^ flip]++;
+
+		swap_keys[cnt] = keys[index];
+		memcpy(swap_values + cnt * value_size, values + index * value_size, value_size);
+	}
+	memcpy(keys, swap_keys, nmemb);
+	memcpy(values, swap_values, nmemb * value_size);
+
+	free(swap_keys);
+}
+
+void flux_count_kv16(unsigned short *keys, char *values, size_t nmemb, size_t value_size, unsigned short flip)
+{
+	size_t *count, index, sum, cnt;
+	unsigned short *swap_keys;
+	char *swap_values;
+
+	count = (size_t *) calloc(65536, sizeof(size_t));
+	swap_keys = (unsigned short *) malloc(nmemb * (value_size + sizeof(short)));
+
+	assert(count != NULL && swap_keys != NULL);
+
+	swap_values = (char *) (swap_keys + nmemb);
+
+	for (index = 0 ; index < nmemb ; index++)
+	{
+		count[keys[index] ^ flip]++;
+	}
+
+	for (index = sum = 0 ; index < 65536 ; index++)
+	{
+		cnt = count[index]; count[index] = sum; sum += cnt;
+	}
+
+	for (index = 0 ; index < nmemb ; index++)
+	{
+		cnt = count[keys[index] ^ flip]++;
+
+		swap_keys[cnt] = keys[index];
+		memcpy(swap_values + cnt * value_size, values + index * value_size, value_size);
+	}
+	memcpy(keys, swap_keys, nmemb * sizeof(short));
+	memcpy(values, swap_values, nmemb * value_size);
+
+	free(swap_keys);
+	free(count);
+}
+
+// comparison functions for 16 bit arrays too small to count
+
+int flux_cmp_int16(const void *a, const void *b)
+{
+	return *(const short *) a - *(const short *) b;
+}
+
+int flux_cmp_uint16(const void *a, const void *b)
+{
+	return *(const unsigned short *) a - *(const unsigned short *) b;
+}
+
+#endif
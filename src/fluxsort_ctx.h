@@ -0,0 +1,339 @@
+// fluxsort_ctx 1.2.1.3 - Igor van den Hoven ivdhoven@gmail.com
+
+#ifndef FLUXSORT_CTX_H
+#define FLUXSORT_CTX_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+#include <float.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef int CMPFUNC (const void *a, const void *b);
+
+//#define cmp(a,b) (*(a) > *(b))
+
+#ifndef FLUXSORT_H
+  #include "fluxsort.h"
+#endif
+
+// A sort context owns a swap arena that is kept between calls and only grows,
+// so once the arena is large enough sorting does no allocation. A zeroed
+// struct flux_ctx is a valid empty context. A context must not be used by
+// two threads at once, flux_ctx_thread() hands out one context per thread.
+
+// The arena grows by at least FLUX_CTX_GROW percent at a time.
+
+#define FLUX_CTX_GROW 50
+
+struct flux_ctx
+{
+	void *swap;
+	size_t swap_size;
+};
+
+// Frees the arena, the context remains usable.
+
+void flux_ctx_release(struct flux_ctx *ctx)
+{
+	free(ctx->swap);
+
+	ctx->swap = NULL;
+	ctx->swap_size = 0;
+}
+
+// Makes sure the arena holds at least bytes, returns 0 if memory is short in
+// which case the arena is empty.
+
+int flux_ctx_reserve(struct flux_ctx *ctx, size_t bytes)
+{
+	size_t grow;
+
+	if (bytes <= ctx->swap_size)
+	{
+		return 1;
+	}
+	grow = ctx->swap_size + ctx->swap_size / 100 * FLUX_CTX_GROW;
+
+	if (grow < bytes)
+	{
+		grow = bytes;
+	}
+	flux_ctx_release(ctx);
+
+	ctx->swap = malloc(grow);
+
+	if (ctx->swap == NULL && grow > bytes)
+	{
+		ctx->swap = malloc(grow = bytes);
+	}
+
+	if (ctx->swap == NULL)
+	{
+		return 0;
+	}
+	ctx->swap_size = grow;
+
+	return 1;
+}
+
+struct flux_ctx *flux_ctx_create(void)
+{
+	return (struct flux_ctx *) calloc(1, sizeof(struct flux_ctx));
+}
+
+void flux_ctx_destroy(struct flux_ctx *ctx)
+{
+	if (ctx)
+	{
+		flux_ctx_release(ctx);
+
+		free(ctx);
+	}
+}
+
+// Every thread gets its own context on first use, which is destroyed when the
+// thread exits.
+
+pthread_key_t flux_ctx_key;
+pthread_once_t flux_ctx_once = PTHREAD_ONCE_INIT;
+
+void flux_ctx_key_destroy(void *ctx)
+{
+	flux_ctx_destroy((struct flux_ctx *) ctx);
+}
+
+void flux_ctx_key_create(void)
+{
+	pthread_key_create(&flux_ctx_key, flux_ctx_key_destroy);
+}
+
+// Returns NULL if memory is short.
+
+struct flux_ctx *flux_ctx_thread(void)
+{
+	struct flux_ctx *ctx;
+
+	pthread_once(&flux_ctx_once, flux_ctx_key_create);
+
+	ctx = (struct flux_ctx *) pthread_getspecific(flux_ctx_key);
+
+	if (ctx == NULL)
+	{
+		ctx = flux_ctx_create();
+
+		if (ctx && pthread_setspecific(flux_ctx_key, ctx))
+		{
+			flux_ctx_destroy(ctx);
+
+			return NULL;
+		}
+	}
+	return ctx;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//┌────────────────────────────────────────────────────────────────────┐//
+//│███████┐██┐     ██┐   ██┐██┐  ██┐███████┐ ██████┐ ██████┐ ████████┐ │//
+//│██┌────┘██│     ██│   ██│└██┐██┌┘██┌────┘██┌───██┐██┌──██┐└──██┌──┘ │//
+//│█████┐  ██│     ██│   ██│ └███┌┘ ███████┐██│   ██│██████┌┘   ██│    │//
+//│██┌──┘  ██│     ██│   ██│ ██┌██┐ └────██│██│   ██│██┌──██┐   ██│    │//
+//│██│     ███████┐└██████┌┘██┌┘ ██┐███████│└██████┌┘██│  ██│   ██│    │//
+//│└─┘     └──────┘ └─────┘ └─┘  └─┘└──────┘ └─────┘ └─┘  └─┘   └─┘    │//
+//└────────────────────────────────────────────────────────────────────┘//
+//////////////////////////////////////////////////////////////////////////
+
+// Bytes of swap a sort needs per record. Record sizes without an instantiation
+// are sorted through an array of pointers, which is kept in the arena along
+// with its swap.
+
+size_t flux_ctx_swap_size(size_t size)
+{
+	switch (size)
+	{
+		case sizeof(char):
+		case sizeof(short):
+		case sizeof(int):
+		case sizeof(long long):
+#ifndef cmp
+		case sizeof(struct96):
+		case sizeof(struct128):
+		case sizeof(struct192):
+		case sizeof(struct256):
+		case sizeof(struct512):
+#elif (DBL_MANT_DIG < LDBL_MANT_DIG)
+		case sizeof(long double):
+#endif
+			return size;
+	}
+	return 2 * sizeof(char *);
+}
+
+// Sorts with the swap arena of ctx, a NULL ctx uses the context of the calling
+// thread. If the arena can't grow the allocating sort is used instead.
+
+void fluxsort_ctx(struct flux_ctx *ctx, void *array, size_t nmemb, size_t size, CMPFUNC *cmp)
+{
+	if (nmemb < 2)
+	{
+		return;
+	}
+
+	if (ctx == NULL)
+	{
+		ctx = flux_ctx_thread();
+	}
+
+	if (ctx == NULL || flux_ctx_reserve(ctx, nmemb * flux_ctx_swap_size(size)) == 0)
+	{
+		fluxsort(array, nmemb, size, cmp);
+		return;
+	}
+
+	switch (size)
+	{
+		case sizeof(char):
+			fluxsort_swap8(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		case sizeof(short):
+			fluxsort_swap16(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		case sizeof(int):
+			fluxsort_swap32(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		case sizeof(long long):
+			fluxsort_swap64(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+#ifndef cmp
+		case sizeof(struct96):
+			fluxsort_swap_struct96(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		case sizeof(struct128):
+			fluxsort_swap_struct128(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		case sizeof(struct192):
+			fluxsort_swap_struct192(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		case sizeof(struct256):
+			fluxsort_swap_struct256(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		case sizeof(struct512):
+			fluxsort_swap_struct512(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		default:
+		{
+			CMPFUNC *func = quad_size_func;
+
+			quad_size_func = cmp;
+			fluxsort_size_swap(array, ctx->swap, ctx->swap_size, nmemb, size, quad_size_cmp);
+			quad_size_func = func;
+		}
+#else
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+		case sizeof(long double):
+			fluxsort_swap128(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+  #endif
+
+		default:
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long) || size == sizeof(long double));
+  #else
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long));
+  #endif
+#endif
+	}
+}
+
+void quadsort_ctx(struct flux_ctx *ctx, void *array, size_t nmemb, size_t size, CMPFUNC *cmp)
+{
+	if (nmemb < 2)
+	{
+		return;
+	}
+
+	if (ctx == NULL)
+	{
+		ctx = flux_ctx_thread();
+	}
+
+	if (ctx == NULL || flux_ctx_reserve(ctx, nmemb * flux_ctx_swap_size(size)) == 0)
+	{
+		quadsort(array, nmemb, size, cmp);
+		return;
+	}
+
+	switch (size)
+	{
+		case sizeof(char):
+			quadsort_swap8(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		case sizeof(short):
+			quadsort_swap16(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		case sizeof(int):
+			quadsort_swap32(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		case sizeof(long long):
+			quadsort_swap64(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+#ifndef cmp
+		case sizeof(struct96):
+			quadsort_swap_struct96(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		case sizeof(struct128):
+			quadsort_swap_struct128(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		case sizeof(struct192):
+			quadsort_swap_struct192(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		case sizeof(struct256):
+			quadsort_swap_struct256(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		case sizeof(struct512):
+			quadsort_swap_struct512(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+
+		default:
+		{
+			CMPFUNC *func = quad_size_func;
+
+			quad_size_func = cmp;
+			quadsort_size_swap(array, ctx->swap, ctx->swap_size, nmemb, size, quad_size_cmp);
+			quad_size_func = func;
+		}
+#else
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+		case sizeof(long double):
+			quadsort_swap128(array, ctx->swap, nmemb, nmemb, cmp);
+			return;
+  #endif
+
+		default:
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long) || size == sizeof(long double));
+  #else
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long));
+  #endif
+#endif
+	}
+}
+
+#endif
@@ -0,0 +1,1172 @@
+// fluxsort_ext 1.2.1.3 - Igor van den Hoven ivdhoven@gmail.com
+
+// External sort for files of fixed size records that don't fit in memory.
+// The input is read in chunks that fill the memory budget, each chunk is
+// sorted with fluxsort and written as a run to a temporary file, after which
+// the runs are merged with a loser tree. When there are more runs than the
+// fan-in, consecutive runs are merged in groups over several passes. Ties are
+// won by the earlier run, so the sort is stable.
+
+// fluxsort_file_pipe() overlaps the disk and the cpu. A reader and a writer
+// thread move the data with pread and pwrite while the calling thread sorts
+// and merges, and the time spent in every stage is reported.
+
+#ifndef FLUXSORT_EXT_H
+#define FLUXSORT_EXT_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+#include <float.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <time.h>
+
+typedef int CMPFUNC (const void *a, const void *b);
+
+//#define cmp(a,b) (*(a) > *(b))
+
+#ifndef FLUXSORT_H
+  #include "fluxsort.h"
+#endif
+
+// The records are sorted by value, which needs the record instantiations that
+// are left out when the cmp macro is defined.
+
+#ifndef cmp
+
+// Defaults for a zeroed struct flux_ext. Merge buffers are kept at least
+// FLUX_EXT_BLOCK bytes so every read and write is large and sequential, the
+// fan-in is lowered when the memory budget can't hold that many buffers.
+
+#define FLUX_EXT_MEMORY 268435456
+#define FLUX_EXT_FAN_IN 64
+#define FLUX_EXT_BLOCK  1048576
+
+struct flux_ext
+{
+	size_t memory;        // bytes of memory to use for buffers
+	size_t fan_in;        // runs merged at once, at least 2
+	const char *temp_dir; // directory of the run files, TMPDIR or /tmp if NULL
+};
+
+struct flux_run
+{
+	off_t offset;
+	off_t bytes;
+};
+
+// One input of the merge, records are consumed from cur to end and refilled
+// from the run file.
+
+struct flux_way
+{
+	char *buf;
+	char *cur;
+	char *end;
+	off_t offset;
+	off_t left;
+};
+
+// Returns 0 on failure with errno set, a negative offset reads or writes at
+// the current file position.
+
+int flux_ext_read(int fd, void *buf, size_t bytes, off_t offset)
+{
+	char *ptb = (char *) buf;
+	ssize_t cnt;
+
+	while (bytes)
+	{
+		cnt = offset < 0 ? read(fd, ptb, bytes) : pread(fd, ptb, bytes, offset);
+
+		if (cnt <= 0)
+		{
+			if (cnt < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (cnt == 0)
+			{
+				errno = EIO;
+			}
+			return 0;
+		}
+		ptb += cnt;
+		bytes -= cnt;
+
+		if (offset >= 0)
+		{
+			offset += cnt;
+		}
+	}
+	return 1;
+}
+
+int flux_ext_write(int fd, const void *buf, size_t bytes, off_t offset)
+{
+	const char *ptb = (const char *) buf;
+	ssize_t cnt;
+
+	while (bytes)
+	{
+		cnt = offset < 0 ? write(fd, ptb, bytes) : pwrite(fd, ptb, bytes, offset);
+
+		if (cnt < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return 0;
+		}
+		ptb += cnt;
+		bytes -= cnt;
+
+		if (offset >= 0)
+		{
+			offset += cnt;
+		}
+	}
+	return 1;
+}
+
+// Creates an unlinked temporary file, which disappears when it is closed.
+
+int flux_ext_temp(const char *dir)
+{
+	char *path;
+	int fd;
+
+	if (dir == NULL)
+	{
+		dir = getenv("TMPDIR");
+	}
+	if (dir == NULL || *dir == 0)
+	{
+		dir = "/tmp";
+	}
+	path = (char *) malloc(strlen(dir) + sizeof("/fluxsort-XXXXXX"));
+
+	if (path == NULL)
+	{
+		return -1;
+	}
+	strcpy(path, dir);
+	strcat(path, "/fluxsort-XXXXXX");
+
+	fd = mkstemp(path);
+
+	if (fd >= 0)
+	{
+		unlink(path);
+	}
+	free(path);
+
+	return fd;
+}
+
+// Sorts a chunk with swap memory from the budget. Record sizes without an
+// instantiation are sorted through pointers, swap then holds 2 * nmemb
+// pointers.
+
+void flux_ext_sort(void *array, void *swap, size_t nmemb, size_t size, CMPFUNC *cmp)
+{
+	switch (size)
+	{
+		case sizeof(char):
+			fluxsort_swap8(array, swap, nmemb, nmemb, cmp);
+			return;
+		case sizeof(short):
+			fluxsort_swap16(array, swap, nmemb, nmemb, cmp);
+			return;
+		case sizeof(int):
+			fluxsort_swap32(array, swap, nmemb, nmemb, cmp);
+			return;
+		case sizeof(long long):
+			fluxsort_swap64(array, swap, nmemb, nmemb, cmp);
+			return;
+		case sizeof(struct96):
+			fluxsort_swap_struct96(array, swap, nmemb, nmemb, cmp);
+			return;
+		case sizeof(struct128):
+			fluxsort_swap_struct128(array, swap, nmemb, nmemb, cmp);
+			return;
+		case sizeof(struct192):
+			fluxsort_swap_struct192(array, swap, nmemb, nmemb, cmp);
+			return;
+		case sizeof(struct256):
+			fluxsort_swap_struct256(array, swap, nmemb, nmemb, cmp);
+			return;
+		case sizeof(struct512):
+			fluxsort_swap_struct512(array, swap, nmemb, nmemb, cmp);
+			return;
+		default:
+		{
+			CMPFUNC *func = quad_size_func;
+
+			quad_size_func = cmp;
+			fluxsort_size_swap(array, swap, 2 * nmemb * sizeof(char *), nmemb, size, quad_size_cmp);
+			quad_size_func = func;
+		}
+	}
+}
+
+// Bytes of swap flux_ext_sort() needs per record.
+
+size_t flux_ext_swap_size(size_t size)
+{
+	switch (size)
+	{
+		case 1: case 2: case 4: case 8: case 12: case 16: case 24: case 32: case 64:
+			return size;
+	}
+	return 2 * sizeof(char *);
+}
+
+// Reads the input in chunks and writes each sorted chunk as a run to fd_out,
+// the number of runs is stored in runs_size. Returns NULL on failure.
+
+struct flux_run *flux_ext_runs(int fd_in, int fd_out, off_t total, size_t memory, size_t size, size_t *runs_size, CMPFUNC *cmp)
+{
+	struct flux_run *runs;
+	size_t chunk, nmemb, cnt;
+	off_t offset;
+	char *array;
+
+	chunk = memory / (size + flux_ext_swap_size(size));
+
+	if ((off_t) chunk * (off_t) size > total)
+	{
+		chunk = total / size;
+	}
+	if (chunk == 0)
+	{
+		chunk = 1;
+	}
+	cnt = (total / size + chunk - 1) / chunk;
+
+	runs = (struct flux_run *) malloc((cnt ? cnt : 1) * sizeof(struct flux_run));
+	array = (char *) malloc(chunk * (size + flux_ext_swap_size(size)));
+
+	if (runs == NULL || array == NULL)
+	{
+		free(runs);
+		free(array);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	for (cnt = 0, offset = 0 ; offset < total ; cnt++)
+	{
+		nmemb = total - offset < (off_t) (chunk * size) ? (total - offset) / size : chunk;
+
+		if (!flux_ext_read(fd_in, array, nmemb * size, -1))
+		{
+			break;
+		}
+		flux_ext_sort(array, array + chunk * size, nmemb, size, cmp);
+
+		if (!flux_ext_write(fd_out, array, nmemb * size, offset))
+		{
+			break;
+		}
+		runs[cnt].offset = offset;
+		runs[cnt].bytes = nmemb * size;
+
+		offset += nmemb * size;
+	}
+	free(array);
+
+	if (offset < total)
+	{
+		free(runs);
+		return NULL;
+	}
+	*runs_size = cnt;
+
+	return runs;
+}
+
+// Returns 1 if the head of run a comes before the head of run b, exhausted
+// runs come last and ties go to the lower run index.
+
+int flux_ext_before(struct flux_way *ways, size_t a, size_t b, CMPFUNC *cmp)
+{
+	int diff;
+
+	if (ways[a].cur == NULL)
+	{
+		return 0;
+	}
+	if (ways[b].cur == NULL)
+	{
+		return 1;
+	}
+	diff = cmp(ways[a].cur, ways[b].cur);
+
+	return diff < 0 || (diff == 0 && a < b);
+}
+
+// Leaves sit at k to 2k - 1, every internal node stores the loser of the match
+// played there and the overall winner is returned.
+
+size_t flux_ext_build(struct flux_way *ways, size_t *tree, size_t k, size_t node, CMPFUNC *cmp)
+{
+	size_t left, right;
+
+	if (node >= k)
+	{
+		return node - k;
+	}
+	left = flux_ext_build(ways, tree, k, node * 2, cmp);
+	right = flux_ext_build(ways, tree, k, node * 2 + 1, cmp);
+
+	if (flux_ext_before(ways, left, right, cmp))
+	{
+		tree[node] = right;
+		return left;
+	}
+	tree[node] = left;
+	return right;
+}
+
+// Refills a drained input, an exhausted run gets a NULL cur.
+
+int flux_ext_fill(int fd, struct flux_way *way, size_t block)
+{
+	size_t bytes = way->left < (off_t) block ? (size_t) way->left : block;
+
+	if (bytes == 0)
+	{
+		way->cur = NULL;
+		return 1;
+	}
+
+	if (!flux_ext_read(fd, way->buf, bytes, way->offset))
+	{
+		return 0;
+	}
+	way->cur = way->buf;
+	way->end = way->buf + bytes;
+	way->offset += bytes;
+	way->left -= bytes;
+
+	return 1;
+}
+
+// Merges k runs of fd_in into one run at offset of fd_out, or at the current
+// position if offset is negative. Block is the size in bytes of each buffer.
+
+int flux_ext_merge(int fd_in, int fd_out, off_t offset, struct flux_run *runs, size_t k, char *memory, size_t block, size_t size, CMPFUNC *cmp)
+{
+	struct flux_way *ways;
+	size_t *tree, winner, node, tmp;
+	char *out, *pto;
+	int ok = 0;
+
+	ways = (struct flux_way *) malloc(k * sizeof(struct flux_way));
+	tree = (size_t *) malloc(k * sizeof(size_t));
+
+	if (ways == NULL || tree == NULL)
+	{
+		errno = ENOMEM;
+		goto end;
+	}
+
+	for (tmp = 0 ; tmp < k ; tmp++)
+	{
+		ways[tmp].buf = memory + tmp * block;
+		ways[tmp].offset = runs[tmp].offset;
+		ways[tmp].left = runs[tmp].bytes;
+
+		if (!flux_ext_fill(fd_in, &ways[tmp], block))
+		{
+			goto end;
+		}
+	}
+	out = pto = memory + k * block;
+
+	winner = flux_ext_build(ways, tree, k, 1, cmp);
+
+	while (ways[winner].cur)
+	{
+		memcpy(pto, ways[winner].cur, size);
+		pto += size;
+
+		if (pto == out + block)
+		{
+			if (!flux_ext_write(fd_out, out, block, offset))
+			{
+				goto end;
+			}
+			if (offset >= 0)
+			{
+				offset += block;
+			}
+			pto = out;
+		}
+		ways[winner].cur += size;
+
+		if (ways[winner].cur == ways[winner].end && !flux_ext_fill(fd_in, &ways[winner], block))
+		{
+			goto end;
+		}
+
+		for (node = (winner + k) / 2 ; node ; node /= 2)
+		{
+			if (flux_ext_before(ways, tree[node], winner, cmp))
+			{
+				tmp = tree[node]; tree[node] = winner; winner = tmp;
+			}
+		}
+	}
+	ok = flux_ext_write(fd_out, out, pto - out, offset);
+
+	end:
+
+	free(ways);
+	free(tree);
+
+	return ok;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Pipeline                                                             //
+//////////////////////////////////////////////////////////////////////////
+
+// Bytes moved or processed by a stage and the seconds it was busy, so
+// bytes / busy is the throughput of the stage by itself.
+
+struct flux_ext_stage
+{
+	off_t bytes;
+	double busy;
+};
+
+// Stall is the time the sorting or merging thread waited on the reader and
+// the writer. A stall close to 0 means the phase is cpu bound, a stall close
+// to elapsed means it is I/O bound.
+
+struct flux_ext_phase
+{
+	struct flux_ext_stage read;
+	struct flux_ext_stage cpu;   // sorting the chunks, or merging the runs
+	struct flux_ext_stage write;
+	double stall;
+	double elapsed;
+};
+
+struct flux_ext_stats
+{
+	struct flux_ext_phase runs;  // run generation
+	struct flux_ext_phase merge; // all merge passes
+	size_t run_count;
+	size_t passes;
+};
+
+#define FLUX_IO_IDLE 0
+#define FLUX_IO_BUSY 1
+#define FLUX_IO_QUIT 2
+
+// An I/O thread with room for one request, the caller hands it a buffer and
+// may not touch that buffer until the next flux_ext_io_wait() or submit. A
+// failed transfer is sticky, every later call returns 0 with its errno.
+
+struct flux_ext_io
+{
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct flux_ext_stage *stage;
+	char *buf;
+	size_t bytes;
+	off_t offset;
+	int fd;
+	int write;
+	int state;
+	int error;
+};
+
+struct flux_ext_pipe
+{
+	struct flux_ext_io reader;
+	struct flux_ext_io writer;
+	struct flux_ext_phase *phase;
+};
+
+double flux_ext_clock(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+void *flux_ext_io_thread(void *arg)
+{
+	struct flux_ext_io *io = (struct flux_ext_io *) arg;
+	double start;
+	int ok;
+
+	pthread_mutex_lock(&io->lock);
+
+	while (1)
+	{
+		while (io->state == FLUX_IO_IDLE)
+		{
+			pthread_cond_wait(&io->cond, &io->lock);
+		}
+		if (io->state == FLUX_IO_QUIT)
+		{
+			break;
+		}
+		pthread_mutex_unlock(&io->lock);
+
+		start = flux_ext_clock();
+
+		if (io->write)
+		{
+			ok = flux_ext_write(io->fd, io->buf, io->bytes, io->offset);
+		}
+		else
+		{
+			ok = flux_ext_read(io->fd, io->buf, io->bytes, io->offset);
+		}
+
+		pthread_mutex_lock(&io->lock);
+
+		if (!ok && io->error == 0)
+		{
+			io->error = errno ? errno : EIO;
+		}
+		io->stage->bytes += io->bytes;
+		io->stage->busy += flux_ext_clock() - start;
+
+		io->state = FLUX_IO_IDLE;
+
+		pthread_cond_broadcast(&io->cond);
+	}
+	pthread_mutex_unlock(&io->lock);
+
+	return NULL;
+}
+
+// Returns 0 with errno set if the thread can't be created.
+
+int flux_ext_io_start(struct flux_ext_io *io, int write)
+{
+	int error;
+
+	memset(io, 0, sizeof(struct flux_ext_io));
+
+	io->write = write;
+
+	pthread_mutex_init(&io->lock, NULL);
+	pthread_cond_init(&io->cond, NULL);
+
+	error = pthread_create(&io->thread, NULL, flux_ext_io_thread, io);
+
+	if (error)
+	{
+		pthread_mutex_destroy(&io->lock);
+		pthread_cond_destroy(&io->cond);
+
+		errno = error;
+		return 0;
+	}
+	return 1;
+}
+
+void flux_ext_io_stop(struct flux_ext_io *io)
+{
+	pthread_mutex_lock(&io->lock);
+
+	while (io->state == FLUX_IO_BUSY)
+	{
+		pthread_cond_wait(&io->cond, &io->lock);
+	}
+	io->state = FLUX_IO_QUIT;
+
+	pthread_cond_broadcast(&io->cond);
+	pthread_mutex_unlock(&io->lock);
+
+	pthread_join(io->thread, NULL);
+
+	pthread_mutex_destroy(&io->lock);
+	pthread_cond_destroy(&io->cond);
+}
+
+// Waits for the pending request, the wait is counted as a stall of phase.
+
+int flux_ext_io_wait(struct flux_ext_io *io, struct flux_ext_phase *phase)
+{
+	double start = flux_ext_clock();
+
+	pthread_mutex_lock(&io->lock);
+
+	while (io->state == FLUX_IO_BUSY)
+	{
+		pthread_cond_wait(&io->cond, &io->lock);
+	}
+	pthread_mutex_unlock(&io->lock);
+
+	phase->stall += flux_ext_clock() - start;
+
+	if (io->error)
+	{
+		errno = io->error;
+		return 0;
+	}
+	return 1;
+}
+
+int flux_ext_io_submit(struct flux_ext_io *io, struct flux_ext_phase *phase, int fd, char *buf, size_t bytes, off_t offset)
+{
+	if (!flux_ext_io_wait(io, phase))
+	{
+		return 0;
+	}
+	if (bytes == 0)
+	{
+		return 1;
+	}
+	pthread_mutex_lock(&io->lock);
+
+	io->stage = io->write ? &phase->write : &phase->read;
+	io->fd = fd;
+	io->buf = buf;
+	io->bytes = bytes;
+	io->offset = offset;
+	io->state = FLUX_IO_BUSY;
+
+	pthread_cond_broadcast(&io->cond);
+	pthread_mutex_unlock(&io->lock);
+
+	return 1;
+}
+
+// Like flux_ext_runs() with the chunk memory split in three, so chunk k + 1
+// is read while chunk k is sorted and chunk k - 1 is written. The slot that
+// is read into was written two chunks ago, which the submit of the previous
+// chunk has waited for.
+
+struct flux_run *flux_ext_runs_pipe(struct flux_ext_pipe *pipe, int fd_in, int fd_out, off_t total, size_t memory, size_t size, size_t *runs_size, CMPFUNC *cmp)
+{
+	struct flux_ext_phase *phase = pipe->phase;
+	struct flux_run *runs;
+	size_t chunk, nmemb, cnt, index;
+	char *array, *swap, *slot;
+	double start;
+	int error;
+
+	chunk = memory / (3 * size + flux_ext_swap_size(size));
+
+	if ((off_t) chunk * (off_t) size > total)
+	{
+		chunk = total / size;
+	}
+	if (chunk == 0)
+	{
+		chunk = 1;
+	}
+	cnt = (total / size + chunk - 1) / chunk;
+
+	runs = (struct flux_run *) malloc((cnt ? cnt : 1) * sizeof(struct flux_run));
+	array = (char *) malloc(chunk * (3 * size + flux_ext_swap_size(size)));
+
+	if (runs == NULL || array == NULL)
+	{
+		free(runs);
+		free(array);
+		errno = ENOMEM;
+		return NULL;
+	}
+	swap = array + 3 * chunk * size;
+
+	for (index = 0 ; index < cnt ; index++)
+	{
+		runs[index].offset = (off_t) index * chunk * size;
+		runs[index].bytes = total - runs[index].offset < (off_t) (chunk * size) ? total - runs[index].offset : (off_t) (chunk * size);
+	}
+
+	if (cnt && !flux_ext_io_submit(&pipe->reader, phase, fd_in, array, runs[0].bytes, 0))
+	{
+		goto fail;
+	}
+
+	for (index = 0 ; index < cnt ; index++)
+	{
+		if (!flux_ext_io_wait(&pipe->reader, phase))
+		{
+			goto fail;
+		}
+		if (index + 1 < cnt && !flux_ext_io_submit(&pipe->reader, phase, fd_in, array + (index + 1) % 3 * chunk * size, runs[index + 1].bytes, runs[index + 1].offset))
+		{
+			goto fail;
+		}
+		slot = array + index % 3 * chunk * size;
+		nmemb = runs[index].bytes / size;
+
+		start = flux_ext_clock();
+
+		flux_ext_sort(slot, swap, nmemb, size, cmp);
+
+		phase->cpu.busy += flux_ext_clock() - start;
+		phase->cpu.bytes += runs[index].bytes;
+
+		if (!flux_ext_io_submit(&pipe->writer, phase, fd_out, slot, runs[index].bytes, runs[index].offset))
+		{
+			goto fail;
+		}
+	}
+
+	if (!flux_ext_io_wait(&pipe->writer, phase))
+	{
+		goto fail;
+	}
+	free(array);
+
+	*runs_size = cnt;
+
+	return runs;
+
+	fail:
+
+	error = errno;
+
+	// the buffer can only go once both threads are done with it
+
+	flux_ext_io_wait(&pipe->reader, phase);
+	flux_ext_io_wait(&pipe->writer, phase);
+
+	free(runs);
+	free(array);
+
+	errno = error;
+
+	return NULL;
+}
+
+int flux_ext_fill_pipe(struct flux_ext_pipe *pipe, int fd, struct flux_way *way, size_t block)
+{
+	size_t bytes = way->left < (off_t) block ? (size_t) way->left : block;
+
+	if (bytes == 0)
+	{
+		way->cur = NULL;
+		return 1;
+	}
+
+	if (!flux_ext_io_submit(&pipe->reader, pipe->phase, fd, way->buf, bytes, way->offset) || !flux_ext_io_wait(&pipe->reader, pipe->phase))
+	{
+		return 0;
+	}
+	way->cur = way->buf;
+	way->end = way->buf + bytes;
+	way->offset += bytes;
+	way->left -= bytes;
+
+	return 1;
+}
+
+// Returns the input that will drain first, which is the one with the smallest
+// last record in its buffer, or k if no input has data left in its run.
+
+size_t flux_ext_forecast(struct flux_way *ways, size_t k, size_t size, CMPFUNC *cmp)
+{
+	size_t index, next = k;
+
+	for (index = 0 ; index < k ; index++)
+	{
+		if (ways[index].cur == NULL || ways[index].left == 0)
+		{
+			continue;
+		}
+		if (next == k || cmp(ways[index].end - size, ways[next].end - size) < 0)
+		{
+			next = index;
+		}
+	}
+	return next;
+}
+
+// Like flux_ext_merge() with one more block for reading ahead and a second
+// output block. The reader fills the next block of the input that will drain
+// first while the merge goes on, and a full output block is handed to the
+// writer while the merge continues in the other one.
+
+int flux_ext_merge_pipe(struct flux_ext_pipe *pipe, int fd_in, int fd_out, off_t offset, struct flux_run *runs, size_t k, char *memory, size_t block, size_t size, CMPFUNC *cmp)
+{
+	struct flux_ext_phase *phase = pipe->phase;
+	struct flux_way *ways;
+	size_t *tree, winner, node, tmp, next, ahead_size = 0;
+	char *ahead, *out, *spare, *pto;
+	int ok = 0;
+
+	ways = (struct flux_way *) malloc(k * sizeof(struct flux_way));
+	tree = (size_t *) malloc(k * sizeof(size_t));
+
+	if (ways == NULL || tree == NULL)
+	{
+		errno = ENOMEM;
+		goto end;
+	}
+
+	for (tmp = 0 ; tmp < k ; tmp++)
+	{
+		ways[tmp].buf = memory + tmp * block;
+		ways[tmp].offset = runs[tmp].offset;
+		ways[tmp].left = runs[tmp].bytes;
+
+		if (!flux_ext_fill_pipe(pipe, fd_in, &ways[tmp], block))
+		{
+			goto end;
+		}
+	}
+	ahead = memory + k * block;
+	out = pto = ahead + block;
+	spare = out + block;
+
+	next = flux_ext_forecast(ways, k, size, cmp);
+
+	if (next < k)
+	{
+		ahead_size = ways[next].left < (off_t) block ? (size_t) ways[next].left : block;
+
+		if (!flux_ext_io_submit(&pipe->reader, phase, fd_in, ahead, ahead_size, ways[next].offset))
+		{
+			goto end;
+		}
+	}
+
+	winner = flux_ext_build(ways, tree, k, 1, cmp);
+
+	while (ways[winner].cur)
+	{
+		memcpy(pto, ways[winner].cur, size);
+		pto += size;
+
+		if (pto == out + block)
+		{
+			if (!flux_ext_io_submit(&pipe->writer, phase, fd_out, out, block, offset))
+			{
+				goto end;
+			}
+			if (offset >= 0)
+			{
+				offset += block;
+			}
+			pto = spare; spare = out; out = pto;
+		}
+		ways[winner].cur += size;
+
+		if (ways[winner].cur == ways[winner].end)
+		{
+			if (winner == next)
+			{
+				if (!flux_ext_io_wait(&pipe->reader, phase))
+				{
+					goto end;
+				}
+				ways[winner].cur = ahead;
+				ahead = ways[winner].buf;
+				ways[winner].buf = ways[winner].cur;
+				ways[winner].end = ways[winner].cur + ahead_size;
+				ways[winner].offset += ahead_size;
+				ways[winner].left -= ahead_size;
+
+				next = flux_ext_forecast(ways, k, size, cmp);
+
+				if (next < k)
+				{
+					ahead_size = ways[next].left < (off_t) block ? (size_t) ways[next].left : block;
+
+					if (!flux_ext_io_submit(&pipe->reader, phase, fd_in, ahead, ahead_size, ways[next].offset))
+					{
+						goto end;
+					}
+				}
+			}
+			else if (!flux_ext_fill_pipe(pipe, fd_in, &ways[winner], block))
+			{
+				goto end;
+			}
+		}
+
+		for (node = (winner + k) / 2 ; node ; node /= 2)
+		{
+			if (flux_ext_before(ways, tree[node], winner, cmp))
+			{
+				tmp = tree[node]; tree[node] = winner; winner = tmp;
+			}
+		}
+	}
+	ok = flux_ext_io_submit(&pipe->writer, phase, fd_out, out, pto - out, offset) && flux_ext_io_wait(&pipe->writer, phase);
+
+	end:
+
+	// the buffers are reused by the next merge
+
+	tmp = errno;
+
+	flux_ext_io_wait(&pipe->reader, phase);
+	flux_ext_io_wait(&pipe->writer, phase);
+
+	errno = tmp;
+
+	free(ways);
+	free(tree);
+
+	return ok;
+}
+
+// Sorts with the reader and writer threads of pipe, or by the calling thread
+// alone if pipe is NULL. The pipeline needs three buffers next to the merge
+// inputs, the serial merge only one.
+
+int flux_ext_file(const char *input, const char *output, size_t size, CMPFUNC *cmp, struct flux_ext *ext, struct flux_ext_pipe *pipe, struct flux_ext_stats *stats)
+{
+	size_t memory, fan_in, block, runs_size, cnt, grp, index, k, extra = pipe ? 3 : 1;
+	struct flux_run *runs = NULL;
+	int fd_in = -1, fd_out = -1, fd_a = -1, fd_b = -1, tmp, ok = 0;
+	const char *temp_dir;
+	char *buffer = NULL;
+	struct stat st;
+	off_t offset;
+	double start;
+
+	memory = ext && ext->memory ? ext->memory : FLUX_EXT_MEMORY;
+	fan_in = ext && ext->fan_in ? ext->fan_in : FLUX_EXT_FAN_IN;
+	fan_in = fan_in < 2 ? 2 : fan_in;
+	temp_dir = ext ? ext->temp_dir : NULL;
+
+	fd_in = open(input, O_RDONLY);
+
+	if (fd_in < 0 || fstat(fd_in, &st) < 0)
+	{
+		goto end;
+	}
+
+	if (size == 0 || st.st_size % size)
+	{
+		errno = EINVAL;
+		goto end;
+	}
+
+	// fan_in buffers plus the extra buffers need to be at least a block each,
+	// and no smaller than a record
+
+	cnt = memory / FLUX_EXT_BLOCK;
+
+	if (fan_in + extra > cnt)
+	{
+		fan_in = cnt > extra + 1 ? cnt - extra : 2;
+	}
+	if (memory < (fan_in + extra) * size)
+	{
+		memory = (fan_in + extra) * size;
+	}
+
+	fd_a = flux_ext_temp(temp_dir);
+
+	if (fd_a < 0)
+	{
+		goto end;
+	}
+	if (pipe)
+	{
+		pipe->phase = &stats->runs;
+
+		start = flux_ext_clock();
+
+		runs = flux_ext_runs_pipe(pipe, fd_in, fd_a, st.st_size, memory, size, &runs_size, cmp);
+
+		stats->runs.elapsed = flux_ext_clock() - start;
+		stats->run_count = runs_size;
+
+		pipe->phase = &stats->merge;
+
+		start = flux_ext_clock();
+	}
+	else
+	{
+		runs = flux_ext_runs(fd_in, fd_a, st.st_size, memory, size, &runs_size, cmp);
+	}
+
+	if (runs == NULL)
+	{
+		goto end;
+	}
+	close(fd_in);
+	fd_in = -1;
+
+	buffer = (char *) malloc(memory);
+
+	if (buffer == NULL)
+	{
+		errno = ENOMEM;
+		goto end;
+	}
+
+	while (runs_size > fan_in)
+	{
+		if (fd_b < 0 && (fd_b = flux_ext_temp(temp_dir)) < 0)
+		{
+			goto end;
+		}
+		// the merged runs replace the runs in front, which have been read
+
+		for (cnt = grp = 0, offset = 0 ; cnt < runs_size ; cnt += k, grp++)
+		{
+			k = runs_size - cnt < fan_in ? runs_size - cnt : fan_in;
+
+			block = memory / (k + extra) / size * size;
+
+			if (pipe)
+			{
+				if (!flux_ext_merge_pipe(pipe, fd_a, fd_b, offset, runs + cnt, k, buffer, block, size, cmp))
+				{
+					goto end;
+				}
+			}
+			else if (!flux_ext_merge(fd_a, fd_b, offset, runs + cnt, k, buffer, block, size, cmp))
+			{
+				goto end;
+			}
+			runs[grp].offset = offset;
+
+			for (index = 1 ; index < k ; index++)
+			{
+				runs[cnt].bytes += runs[cnt + index].bytes;
+			}
+			runs[grp].bytes = runs[cnt].bytes;
+
+			offset += runs[grp].bytes;
+		}
+		runs_size = grp;
+
+		tmp = fd_a; fd_a = fd_b; fd_b = tmp;
+
+		if (pipe)
+		{
+			stats->passes++;
+		}
+	}
+
+	fd_out = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd_out < 0)
+	{
+		goto end;
+	}
+
+	if (runs_size == 0)
+	{
+		ok = 1;
+		goto end;
+	}
+	block = memory / (runs_size + extra) / size * size;
+
+	if (pipe)
+	{
+		ok = flux_ext_merge_pipe(pipe, fd_a, fd_out, -1, runs, runs_size, buffer, block, size, cmp);
+
+		stats->passes++;
+		stats->merge.elapsed = flux_ext_clock() - start;
+		stats->merge.cpu.bytes = (off_t) stats->passes * st.st_size;
+		stats->merge.cpu.busy = stats->merge.elapsed - stats->merge.stall;
+	}
+	else
+	{
+		ok = flux_ext_merge(fd_a, fd_out, -1, runs, runs_size, buffer, block, size, cmp);
+	}
+
+	end:
+
+	tmp = errno;
+
+	if (fd_out >= 0 && close(fd_out) < 0 && ok)
+	{
+		tmp = errno;
+		ok = 0;
+	}
+	if (fd_in >= 0)
+	{
+		close(fd_in);
+	}
+	if (fd_a >= 0)
+	{
+		close(fd_a);
+	}
+	if (fd_b >= 0)
+	{
+		close(fd_b);
+	}
+	free(runs);
+	free(buffer);
+
+	errno = tmp;
+
+	return ok;
+}
+
+// Sorts the records of size bytes in the input file and writes them to the
+// output file, which may be the same file. A NULL ext uses the defaults.
+// Returns 0 on failure with errno set.
+
+int fluxsort_file(const char *input, const char *output, size_t size, CMPFUNC *cmp, struct flux_ext *ext)
+{
+	return flux_ext_file(input, output, size, cmp, ext, NULL, NULL);
+}
+
+// Like fluxsort_file() with the reading and writing done by two threads, so
+// the disk and the cpu work at the same time. The time and bytes of every
+// stage are stored in stats, which may be NULL. Compile with -pthread.
+
+int fluxsort_file_pipe(const char *input, const char *output, size_t size, CMPFUNC *cmp, struct flux_ext *ext, struct flux_ext_stats *stats)
+{
+	struct flux_ext_stats dummy;
+	struct flux_ext_pipe pipe;
+	int ok, error;
+
+	if (stats == NULL)
+	{
+		stats = &dummy;
+	}
+	memset(stats, 0, sizeof(struct flux_ext_stats));
+
+	pipe.phase = &stats->runs;
+
+	if (!flux_ext_io_start(&pipe.reader, 0))
+	{
+		return 0;
+	}
+	if (!flux_ext_io_start(&pipe.writer, 1))
+	{
+		error = errno;
+		flux_ext_io_stop(&pipe.reader);
+		errno = error;
+		return 0;
+	}
+	ok = flux_ext_file(input, output, size, cmp, ext, &pipe, stats);
+
+	error = errno;
+
+	flux_ext_io_stop(&pipe.reader);
+	flux_ext_io_stop(&pipe.writer);
+
+	errno = error;
+
+	return ok;
+}
+
+#endif
+
+#endif
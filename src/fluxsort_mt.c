@@ -0,0 +1,728 @@
+// fluxsort_mt 1.2.1.3 - Igor van den Hoven ivdhoven@gmail.com
+
+// A partition owns array[0..nmemb) and swap[0..nmemb), its data is located
+// at ptx, which is either array or swap. After a split the swap side owns
+// array[a_size..nmemb) and swap[0..s_size) while the main side owns
+// array[0..a_size) and swap[s_size..nmemb), so the two sides can be sorted
+// by different threads without sharing memory. Threads is the number of
+// threads a partition is expected to keep busy, it is divided between the
+// two sides of every split.
+
+struct FUNC(flux_part)
+{
+	struct flux_job job;
+	VAR *array, *swap, *ptx;
+	size_t nmemb, threads;
+	CMPFUNC *cmp;
+};
+
+struct FUNC(flux_block)
+{
+	struct flux_job job;
+	VAR *ptx, *dest, *pta, *pts, *piv;
+	size_t nmemb, a_size, *group;
+#ifndef cmp
+	CMPFUNC *cmp;
+#endif
+};
+
+struct FUNC(flux_quad)
+{
+	struct flux_job job;
+	VAR *array, *swap;
+	size_t nmemb;
+	CMPFUNC *cmp;
+};
+
+struct FUNC(flux_merge)
+{
+	struct flux_job job;
+	VAR *dest, *ptl, *ptr;
+	size_t left, right;
+	CMPFUNC *cmp;
+};
+
+void FUNC(flux_partition_mt)(struct flux_pool *pool, size_t id, VAR *array, VAR *swap, VAR *ptx, size_t nmemb, size_t threads, CMPFUNC *cmp);
+
+void FUNC(flux_part_job)(struct flux_pool *pool, size_t id, struct flux_job *job)
+{
+	struct FUNC(flux_part) *part = (struct FUNC(flux_part) *) job;
+
+	FUNC(flux_partition_mt)(pool, id, part->array, part->swap, part->ptx, part->nmemb, part->threads, part->cmp);
+
+	free(part);
+}
+
+void FUNC(flux_spawn_partition)(struct flux_pool *pool, size_t id, VAR *array, VAR *swap, VAR *ptx, size_t nmemb, size_t threads, CMPFUNC *cmp)
+{
+	struct FUNC(flux_part) *part = NULL;
+
+	if (nmemb > FLUX_MT_SPLIT / 16)
+	{
+		part = (struct FUNC(flux_part) *) malloc(sizeof(struct FUNC(flux_part)));
+	}
+
+	if (part)
+	{
+		part->job.func = FUNC(flux_part_job);
+		part->array = array;
+		part->swap = swap;
+		part->ptx = ptx;
+		part->nmemb = nmemb;
+		part->threads = threads;
+		part->cmp = cmp;
+
+		if (flux_pool_push(pool, id, &part->job))
+		{
+			return;
+		}
+		free(part);
+	}
+	FUNC(flux_partition_mt)(pool, id, array, swap, ptx, nmemb, threads, cmp);
+}
+
+void FUNC(flux_block_split)(struct flux_pool *pool, size_t id, struct flux_job *job)
+{
+	struct FUNC(flux_block) *block = (struct FUNC(flux_block) *) job;
+	VAR *ptx = block->ptx, *pta = block->dest, *pts = block->dest + block->nmemb - 1, *piv = block->piv;
+#ifndef cmp
+	CMPFUNC *cmp = block->cmp;
+#endif
+	size_t cnt, val;
+
+	for (cnt = block->nmemb ; cnt ; cnt--)
+	{
+		val = cmp(ptx, piv) <= 0; *pta = *pts = *ptx++; pta += val; pts -= !val;
+	}
+	block->a_size = pta - block->dest;
+
+	flux_pool_leave(pool, block->group);
+}
+
+void FUNC(flux_block_scatter)(struct flux_pool *pool, size_t id, struct flux_job *job)
+{
+	struct FUNC(flux_block) *block = (struct FUNC(flux_block) *) job;
+	VAR *ptd = block->dest + block->nmemb - 1, *pts = block->pts;
+	size_t cnt;
+
+	memcpy(block->pta, block->dest, block->a_size * sizeof(VAR));
+
+	for (cnt = block->nmemb - block->a_size ; cnt ; cnt--)
+	{
+		*pts++ = *ptd--;
+	}
+	flux_pool_leave(pool, block->group);
+}
+
+void FUNC(flux_block_copy)(struct flux_pool *pool, size_t id, struct flux_job *job)
+{
+	struct FUNC(flux_block) *block = (struct FUNC(flux_block) *) job;
+
+	memcpy(block->dest, block->ptx, block->nmemb * sizeof(VAR));
+
+	flux_pool_leave(pool, block->group);
+}
+
+void FUNC(flux_block_run)(struct flux_pool *pool, size_t id, struct FUNC(flux_block) *block, size_t parts, void (*func)(struct flux_pool *, size_t, struct flux_job *))
+{
+	size_t group = parts, cnt;
+
+	for (cnt = 0 ; cnt < parts ; cnt++)
+	{
+		block[cnt].job.func = func;
+		block[cnt].group = &group;
+
+		if (cnt + 1 == parts || !flux_pool_push(pool, id, &block[cnt].job))
+		{
+			func(pool, id, &block[cnt].job);
+		}
+	}
+	flux_pool_wait(pool, id, &group);
+}
+
+// Stable parallel version of flux_default_partition(). Every block is split
+// into the other buffer, elements <= pivot at the front and elements > pivot
+// at the back in reverse order. A prefix sum over the block counts gives the
+// final location of each block in ptx, with the side that stays in ptx
+// placed first, after which the other side is copied out.
+
+size_t FUNC(flux_block_partition)(struct flux_pool *pool, size_t id, VAR *array, VAR *swap, VAR *ptx, VAR *piv, size_t nmemb, size_t threads, CMPFUNC *cmp)
+{
+	struct FUNC(flux_block) *block = NULL;
+	VAR *pta, *pts, *from, *dest;
+	size_t parts, size, cnt, a_size, s_size;
+
+	parts = nmemb / FLUX_MT_SPLIT < threads ? nmemb / FLUX_MT_SPLIT : threads;
+
+	if (parts > 2)
+	{
+		block = (struct FUNC(flux_block) *) malloc(parts * sizeof(struct FUNC(flux_block)));
+	}
+
+	if (block == NULL)
+	{
+		return FUNC(flux_default_partition)(array, swap, ptx, piv, nmemb, cmp);
+	}
+	size = nmemb / parts;
+
+	for (cnt = 0 ; cnt < parts ; cnt++)
+	{
+		block[cnt].ptx = ptx + cnt * size;
+		block[cnt].dest = (ptx == array ? swap : array) + cnt * size;
+		block[cnt].nmemb = cnt + 1 < parts ? size : nmemb - cnt * size;
+		block[cnt].piv = piv;
+#ifndef cmp
+		block[cnt].cmp = cmp;
+#endif
+	}
+	FUNC(flux_block_run)(pool, id, block, parts, FUNC(flux_block_split));
+
+	for (a_size = cnt = 0 ; cnt < parts ; cnt++)
+	{
+		a_size += block[cnt].a_size;
+	}
+	s_size = nmemb - a_size;
+
+	pta = ptx == array ? ptx : ptx + s_size;
+	pts = ptx == array ? ptx + a_size : ptx;
+
+	for (cnt = 0 ; cnt < parts ; cnt++)
+	{
+		block[cnt].pta = pta;
+		block[cnt].pts = pts;
+
+		pta += block[cnt].a_size;
+		pts += block[cnt].nmemb - block[cnt].a_size;
+	}
+	FUNC(flux_block_run)(pool, id, block, parts, FUNC(flux_block_scatter));
+
+	from = ptx == array ? array + a_size : swap + s_size;
+	dest = ptx == array ? swap : array;
+	nmemb = ptx == array ? s_size : a_size;
+	size = nmemb / parts;
+
+	for (cnt = 0 ; cnt < parts ; cnt++)
+	{
+		block[cnt].ptx = from + cnt * size;
+		block[cnt].dest = dest + cnt * size;
+		block[cnt].nmemb = cnt + 1 < parts ? size : nmemb - cnt * size;
+	}
+	FUNC(flux_block_run)(pool, id, block, parts, FUNC(flux_block_copy));
+
+	free(block);
+
+	return a_size;
+}
+
+// Mirrors flux_partition(), except that the swap side is handed to the pool
+// and the pivot is kept on the stack until the main side is known to have
+// room for it at the end of its swap memory.
+
+void FUNC(flux_partition_mt)(struct flux_pool *pool, size_t id, VAR *array, VAR *swap, VAR *ptx, size_t nmemb, size_t threads, CMPFUNC *cmp)
+{
+	size_t a_size = 0, s_size;
+	VAR piv, prev, *max = NULL;
+	int generic = 0;
+
+	while (nmemb > FLUX_MT_SPLIT)
+	{
+		piv = FUNC(median_of_cbrt)(array, swap, ptx, nmemb, &generic, cmp);
+
+		if (generic)
+		{
+			if (ptx == swap)
+			{
+				memcpy(array, swap, nmemb * sizeof(VAR));
+			}
+			FUNC(quadsort_swap)(array, swap, nmemb, nmemb, cmp);
+			return;
+		}
+
+		if (max && cmp(max, &piv) <= 0)
+		{
+			swap[nmemb - 1] = piv;
+
+			FUNC(flux_reverse_partition)(array, swap, array, swap + nmemb - 1, nmemb, cmp);
+			return;
+		}
+		a_size = FUNC(flux_block_partition)(pool, id, array, swap, ptx, &piv, nmemb, threads, cmp);
+		s_size = nmemb - a_size;
+
+		if (a_size == 0)
+		{
+			return;
+		}
+
+		if (s_size == 0)
+		{
+			swap[nmemb - 1] = piv;
+
+			FUNC(flux_reverse_partition)(array, swap, array, swap + nmemb - 1, nmemb, cmp);
+			return;
+		}
+
+		if (a_size <= s_size / 32 || s_size <= FLUX_OUT)
+		{
+			memcpy(array + a_size, swap, s_size * sizeof(VAR));
+			FUNC(quadsort_swap)(array + a_size, swap, s_size, s_size, cmp);
+		}
+		else
+		{
+			FUNC(flux_spawn_partition)(pool, id, array + a_size, swap, swap, s_size, threads * s_size / nmemb, cmp);
+
+			threads -= threads * s_size / nmemb;
+		}
+
+		swap += s_size;
+
+		if (s_size <= a_size / 32 || a_size <= FLUX_OUT)
+		{
+			if (a_size <= FLUX_OUT)
+			{
+				FUNC(quadsort_swap)(array, swap, a_size, a_size, cmp);
+			}
+			else
+			{
+				swap[a_size - 1] = piv;
+
+				FUNC(flux_reverse_partition)(array, swap, array, swap + a_size - 1, a_size, cmp);
+			}
+			return;
+		}
+		nmemb = a_size;
+		ptx = array;
+		prev = piv;
+		max = &prev;
+	}
+
+	if (ptx == swap)
+	{
+		memcpy(array, swap, nmemb * sizeof(VAR));
+	}
+
+	if (nmemb <= FLUX_OUT)
+	{
+		FUNC(quadsort_swap)(array, swap, nmemb, nmemb, cmp);
+	}
+	else
+	{
+		FUNC(flux_partition)(array, swap, array, swap + nmemb, nmemb, cmp);
+	}
+}
+
+void FUNC(flux_quad_job)(struct flux_pool *pool, size_t id, struct flux_job *job)
+{
+	struct FUNC(flux_quad) *quad = (struct FUNC(flux_quad) *) job;
+
+	FUNC(quadsort_swap)(quad->array, quad->swap, quad->nmemb, quad->nmemb, quad->cmp);
+
+	free(quad);
+}
+
+// Returns 0 if the job could not be queued, in which case the caller should
+// run it.
+
+int FUNC(flux_spawn_quad)(struct flux_pool *pool, size_t id, VAR *array, VAR *swap, size_t nmemb, CMPFUNC *cmp)
+{
+	struct FUNC(flux_quad) *quad = (struct FUNC(flux_quad) *) malloc(sizeof(struct FUNC(flux_quad)));
+
+	if (quad == NULL)
+	{
+		return 0;
+	}
+	quad->job.func = FUNC(flux_quad_job);
+	quad->array = array;
+	quad->swap = swap;
+	quad->nmemb = nmemb;
+	quad->cmp = cmp;
+
+	if (flux_pool_push(pool, id, &quad->job))
+	{
+		return 1;
+	}
+	free(quad);
+
+	return 0;
+}
+
+// merges one slice of a merge path, either side can be empty
+
+void FUNC(flux_merge_slice)(VAR *dest, VAR *ptl, VAR *ptr, size_t left, size_t right, CMPFUNC *cmp)
+{
+	if (right == 0)
+	{
+		memcpy(dest, ptl, left * sizeof(VAR));
+	}
+	else if (left == 0)
+	{
+		memcpy(dest, ptr, right * sizeof(VAR));
+	}
+	else if (cmp(ptl + left - 1, ptr) <= 0)
+	{
+		memcpy(dest, ptl, left * sizeof(VAR));
+		memcpy(dest + left, ptr, right * sizeof(VAR));
+	}
+	else
+	{
+		FUNC(twin_merge)(dest, ptl, ptr, left, right, cmp);
+	}
+}
+
+void FUNC(flux_merge_job)(struct flux_pool *pool, size_t id, struct flux_job *job)
+{
+	struct FUNC(flux_merge) *merge = (struct FUNC(flux_merge) *) job;
+
+	FUNC(flux_merge_slice)(merge->dest, merge->ptl, merge->ptr, merge->left, merge->right, merge->cmp);
+
+	free(merge);
+}
+
+// Merge path: the merge of from[0..left) and from[left..left+right) into
+// dest is cut into parts slices of equal output size. For each cut a binary
+// search finds how many elements i are taken from the left run, such that
+// left[i - 1] <= right[k - i - 1] < left[i], which keeps the merge stable.
+// The slices are handed to the pool, the caller should wait for the pool to
+// finish before using dest.
+
+void FUNC(cross_merge_mt)(struct flux_pool *pool, size_t id, VAR *dest, VAR *from, size_t left, size_t right, size_t parts, CMPFUNC *cmp)
+{
+	struct FUNC(flux_merge) *merge;
+	VAR *ptl = from, *ptr = from + left;
+	size_t nmemb = left + right, part, k, lo, hi, mid, i0, j0, i1, j1;
+
+	if (parts > nmemb / (FLUX_MT_SPLIT / 4))
+	{
+		parts = nmemb / (FLUX_MT_SPLIT / 4);
+	}
+
+	if (parts == 0)
+	{
+		parts = 1;
+	}
+
+	for (part = 1, i0 = j0 = 0 ; part <= parts ; part++)
+	{
+		if (part == parts)
+		{
+			i1 = left;
+			j1 = right;
+		}
+		else
+		{
+			k = nmemb / parts * part;
+			lo = k > right ? k - right : 0;
+			hi = k < left ? k : left;
+
+			while (lo < hi)
+			{
+				mid = lo + (hi - lo) / 2;
+
+				if (cmp(ptl + mid, ptr + (k - mid - 1)) <= 0)
+				{
+					lo = mid + 1;
+				}
+				else
+				{
+					hi = mid;
+				}
+			}
+			i1 = lo;
+			j1 = k - lo;
+		}
+		merge = (struct FUNC(flux_merge) *) malloc(sizeof(struct FUNC(flux_merge)));
+
+		if (merge)
+		{
+			merge->job.func = FUNC(flux_merge_job);
+			merge->dest = dest + i0 + j0;
+			merge->ptl = ptl + i0;
+			merge->ptr = ptr + j0;
+			merge->left = i1 - i0;
+			merge->right = j1 - j0;
+			merge->cmp = cmp;
+
+			if (!flux_pool_push(pool, id, &merge->job))
+			{
+				free(merge);
+				merge = NULL;
+			}
+		}
+
+		if (merge == NULL)
+		{
+			FUNC(flux_merge_slice)(dest + i0 + j0, ptl + i0, ptr + j0, i1 - i0, j1 - j0, cmp);
+		}
+		i0 = i1;
+		j0 = j1;
+	}
+}
+
+// Same analysis as flux_analyze(), but the four quadrants are sorted as
+// independent jobs, after which the halves are merged using merge path.
+// Adjacent quadrants without streaks are partitioned together. The
+// QUAD_CACHE override is left out as large partitions are split between
+// threads.
+
+void FUNC(flux_analyze_mt)(struct flux_pool *pool, VAR *array, VAR *swap, size_t nmemb, CMPFUNC *cmp)
+{
+	unsigned char loop, asum, bsum, csum, dsum;
+	unsigned int astreaks, bstreaks, cstreaks, dstreaks;
+	size_t quad1, quad2, quad3, quad4, half1, half2;
+	size_t cnt, abalance, bbalance, cbalance, dbalance;
+	size_t quad[4], balance[4], size;
+	unsigned char ordered[4];
+	VAR *pta, *ptb, *ptc, *ptd, *pts;
+
+	half1 = nmemb / 2;
+	quad1 = half1 / 2;
+	quad2 = half1 - quad1;
+	half2 = nmemb - half1;
+	quad3 = half2 / 2;
+	quad4 = half2 - quad3;
+
+	pta = array;
+	ptb = array + quad1;
+	ptc = array + half1;
+	ptd = array + half1 + quad3;
+
+	astreaks = bstreaks = cstreaks = dstreaks = 0;
+	abalance = bbalance = cbalance = dbalance = 0;
+
+	if (quad1 < quad2) {bbalance += cmp(ptb, ptb + 1) > 0; ptb++;}
+	if (quad1 < quad3) {cbalance += cmp(ptc, ptc + 1) > 0; ptc++;}
+	if (quad1 < quad4) {dbalance += cmp(ptd, ptd + 1) > 0; ptd++;}
+
+	for (cnt = nmemb ; cnt > 132 ; cnt -= 128)
+	{
+		for (asum = bsum = csum = dsum = 0, loop = 32 ; loop ; loop--)
+		{
+			asum += cmp(pta, pta + 1) > 0; pta++;
+			bsum += cmp(ptb, ptb + 1) > 0; ptb++;
+			csum += cmp(ptc, ptc + 1) > 0; ptc++;
+			dsum += cmp(ptd, ptd + 1) > 0; ptd++;
+		}
+		abalance += asum; astreaks += asum = (asum == 0) | (asum == 32);
+		bbalance += bsum; bstreaks += bsum = (bsum == 0) | (bsum == 32);
+		cbalance += csum; cstreaks += csum = (csum == 0) | (csum == 32);
+		dbalance += dsum; dstreaks += dsum = (dsum == 0) | (dsum == 32);
+
+		if (cnt > 516 && asum + bsum + csum + dsum == 0)
+		{
+			abalance += 48; pta += 96;
+			bbalance += 48; ptb += 96;
+			cbalance += 48; ptc += 96;
+			dbalance += 48; ptd += 96;
+			cnt -= 384;
+		}
+	}
+
+	for ( ; cnt > 7 ; cnt -= 4)
+	{
+		abalance += cmp(pta, pta + 1) > 0; pta++;
+		bbalance += cmp(ptb, ptb + 1) > 0; ptb++;
+		cbalance += cmp(ptc, ptc + 1) > 0; ptc++;
+		dbalance += cmp(ptd, ptd + 1) > 0; ptd++;
+	}
+
+	cnt = abalance + bbalance + cbalance + dbalance;
+
+	if (cnt == 0)
+	{
+		if (cmp(pta, pta + 1) <= 0 && cmp(ptb, ptb + 1) <= 0 && cmp(ptc, ptc + 1) <= 0)
+		{
+			return;
+		}
+	}
+
+	asum = quad1 - abalance == 1;
+	bsum = quad2 - bbalance == 1;
+	csum = quad3 - cbalance == 1;
+	dsum = quad4 - dbalance == 1;
+
+	if (asum | bsum | csum | dsum)
+	{
+		unsigned char span1 = (asum && bsum) * (cmp(pta, pta + 1) > 0);
+		unsigned char span2 = (bsum && csum) * (cmp(ptb, ptb + 1) > 0);
+		unsigned char span3 = (csum && dsum) * (cmp(ptc, ptc + 1) > 0);
+
+		switch (span1 | span2 * 2 | span3 * 4)
+		{
+			case 0: break;
+			case 1: FUNC(quad_reversal)(array, ptb);   abalance = bbalance = 0; break;
+			case 2: FUNC(quad_reversal)(pta + 1, ptc); bbalance = cbalance = 0; break;
+			case 3: FUNC(quad_reversal)(array, ptc);   abalance = bbalance = cbalance = 0; break;
+			case 4: FUNC(quad_reversal)(ptb + 1, ptd); cbalance = dbalance = 0; break;
+			case 5: FUNC(quad_reversal)(array, ptb);
+				FUNC(quad_reversal)(ptb + 1, ptd); abalance = bbalance = cbalance = dbalance = 0; break;
+			case 6: FUNC(quad_reversal)(pta + 1, ptd); bbalance = cbalance = dbalance = 0; break;
+			case 7: FUNC(quad_reversal)(array, ptd); return;
+		}
+		if (asum && abalance) {FUNC(quad_reversal)(array,   pta); abalance = 0;}
+		if (bsum && bbalance) {FUNC(quad_reversal)(pta + 1, ptb); bbalance = 0;}
+		if (csum && cbalance) {FUNC(quad_reversal)(ptb + 1, ptc); cbalance = 0;}
+		if (dsum && dbalance) {FUNC(quad_reversal)(ptc + 1, ptd); dbalance = 0;}
+	}
+
+#ifdef cmp
+	cnt = nmemb / 256; // switch to quadsort if at least 50% ordered
+#else
+	cnt = nmemb / 512; // switch to quadsort if at least 25% ordered
+#endif
+	ordered[0] = astreaks > cnt; quad[0] = quad1; balance[0] = abalance;
+	ordered[1] = bstreaks > cnt; quad[1] = quad2; balance[1] = bbalance;
+	ordered[2] = cstreaks > cnt; quad[2] = quad3; balance[2] = cbalance;
+	ordered[3] = dstreaks > cnt; quad[3] = quad4; balance[3] = dbalance;
+
+	if (ordered[0] + ordered[1] + ordered[2] + ordered[3] == 0)
+	{
+		FUNC(flux_partition_mt)(pool, 0, array, swap, array, nmemb, pool->threads, cmp);
+		flux_pool_work(pool, 0, 1);
+		return;
+	}
+
+	for (cnt = 0, pts = array ; cnt < 4 ; pts += size)
+	{
+		if (ordered[cnt])
+		{
+			size = quad[cnt];
+
+			if (balance[cnt++] && !FUNC(flux_spawn_quad)(pool, 0, pts, swap + (pts - array), size, cmp))
+			{
+				FUNC(quadsort_swap)(pts, swap + (pts - array), size, size, cmp);
+			}
+		}
+		else
+		{
+			for (size = 0 ; cnt < 4 && ordered[cnt] == 0 ; cnt++)
+			{
+				size += quad[cnt];
+			}
+			FUNC(flux_spawn_partition)(pool, 0, pts, swap + (pts - array), pts, size, pool->threads * size / nmemb, cmp);
+		}
+	}
+	flux_pool_work(pool, 0, 1);
+
+	if (cmp(pta, pta + 1) <= 0 && cmp(ptb, ptb + 1) <= 0 && cmp(ptc, ptc + 1) <= 0)
+	{
+		return;
+	}
+	FUNC(cross_merge_mt)(pool, 0, swap, array, quad1, quad2, pool->threads / 2, cmp);
+	FUNC(cross_merge_mt)(pool, 0, swap + half1, array + half1, quad3, quad4, pool->threads / 2, cmp);
+	flux_pool_work(pool, 0, 1);
+
+	FUNC(cross_merge_mt)(pool, 0, array, swap, half1, half2, pool->threads, cmp);
+	flux_pool_work(pool, 0, 1);
+}
+
+void FUNC(fluxsort_mt)(void *array, size_t nmemb, CMPFUNC *cmp, size_t threads)
+{
+	VAR *pta = (VAR *) array;
+	VAR *swap;
+	struct flux_pool *pool;
+	struct flux_alloc *policy = flux_swap_policy;
+
+	if (nmemb <= FLUX_MT_SPLIT || threads <= 1)
+	{
+		FUNC(fluxsort)(array, nmemb, cmp);
+		return;
+	}
+	swap = (VAR *) policy->alloc(nmemb * sizeof(VAR));
+
+	if (swap == NULL)
+	{
+		FUNC(quadsort)(array, nmemb, cmp);
+		return;
+	}
+	pool = flux_pool_create(threads);
+
+	if (pool == NULL)
+	{
+		FUNC(flux_analyze)(pta, swap, nmemb, nmemb, cmp);
+	}
+	else
+	{
+		FUNC(flux_analyze_mt)(pool, pta, swap, nmemb, cmp);
+
+		flux_pool_destroy(pool);
+	}
+	policy->release(swap, nmemb * sizeof(VAR));
+}
+
+// Sorts one block per thread with quadsort_swap(), after which the blocks are
+// merged pairwise, alternating between array and swap. Every pairwise merge
+// is split with merge path so all threads stay busy during the final merges.
+
+void FUNC(quad_sort_mt)(struct flux_pool *pool, VAR *array, VAR *swap, size_t nmemb, CMPFUNC *cmp)
+{
+	VAR *from = array, *dest = swap, *tmp;
+	size_t parts, block, offset, left, right;
+
+	for (parts = 1 ; parts < pool->threads && nmemb / parts > FLUX_MT_SPLIT ; parts *= 2);
+
+	block = (nmemb + parts - 1) / parts;
+
+	for (offset = 0 ; offset < nmemb ; offset += block)
+	{
+		left = nmemb - offset < block ? nmemb - offset : block;
+
+		if (!FUNC(flux_spawn_quad)(pool, 0, array + offset, swap + offset, left, cmp))
+		{
+			FUNC(quadsort_swap)(array + offset, swap + offset, left, left, cmp);
+		}
+	}
+	flux_pool_work(pool, 0, 1);
+
+	for ( ; block < nmemb ; block *= 2)
+	{
+		for (offset = 0 ; offset < nmemb ; offset += left + right)
+		{
+			left = nmemb - offset < block ? nmemb - offset : block;
+			right = nmemb - offset - left < block ? nmemb - offset - left : block;
+
+			FUNC(cross_merge_mt)(pool, 0, dest + offset, from + offset, left, right, pool->threads * (left + right) / nmemb, cmp);
+		}
+		flux_pool_work(pool, 0, 1);
+
+		tmp = from; from = dest; dest = tmp;
+	}
+
+	if (from != array)
+	{
+		FUNC(cross_merge_mt)(pool, 0, array, from, nmemb, 0, pool->threads, cmp);
+		flux_pool_work(pool, 0, 1);
+	}
+}
+
+void FUNC(quadsort_mt)(void *array, size_t nmemb, CMPFUNC *cmp, size_t threads)
+{
+	VAR *pta = (VAR *) array;
+	VAR *swap;
+	struct flux_pool *pool;
+	struct flux_alloc *policy = flux_swap_policy;
+
+	if (nmemb <= FLUX_MT_SPLIT || threads <= 1)
+	{
+		FUNC(quadsort)(array, nmemb, cmp);
+		return;
+	}
+	swap = (VAR *) policy->alloc(nmemb * sizeof(VAR));
+
+	if (swap == NULL)
+	{
+		FUNC(quadsort)(array, nmemb, cmp);
+		return;
+	}
+	pool = flux_pool_create(threads);
+
+	if (pool == NULL)
+	{
+		FUNC(quadsort_swap)(pta, swap, nmemb, nmemb, cmp);
+	}
+	else
+	{
+		FUNC(quad_sort_mt)(pool, pta, swap, nmemb, cmp);
+
+		flux_pool_destroy(pool);
+	}
+	policy->release(swap, nmemb * sizeof(VAR));
+}
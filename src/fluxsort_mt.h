@@ -0,0 +1,669 @@
+// fluxsort_mt 1.2.1.3 - Igor van den Hoven ivdhoven@gmail.com
+
+#ifndef FLUXSORT_MT_H
+#define FLUXSORT_MT_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+#include <float.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+typedef int CMPFUNC (const void *a, const void *b);
+
+//#define cmp(a,b) (*(a) > *(b))
+
+#ifndef FLUXSORT_H
+  #include "fluxsort.h"
+#endif
+
+// Partitions larger than FLUX_MT_SPLIT elements are handed to the thread pool,
+// smaller partitions are sorted by a single thread using flux_partition().
+
+#define FLUX_MT_SPLIT 65536
+
+// Never start more than FLUX_MT_MAX threads.
+
+#define FLUX_MT_MAX 256
+
+//////////////////////////////////////////////////////////////
+//┌────────────────────────────────────────────────────────┐//
+//│██████┐  ██████┐  ██████┐ ██┐                           │//
+//│██┌──██┐██┌───██┐██┌───██┐██│                           │//
+//│██████┌┘██│   ██│██│   ██│██│                           │//
+//│██┌───┘ ██│   ██│██│   ██│██│                           │//
+//│██│     └██████┌┘└██████┌┘███████┐                      │//
+//│└─┘      └─────┘  └─────┘ └──────┘                      │//
+//└────────────────────────────────────────────────────────┘//
+//////////////////////////////////////////////////////////////
+
+// A work-stealing pool. Every thread owns a deque, it pushes and pops jobs at
+// the tail of its own deque, and steals jobs from the head of other deques
+// when it runs dry. Jobs are coarse, so a mutex per deque is sufficient.
+
+struct flux_pool;
+
+struct flux_job
+{
+	void (*func)(struct flux_pool *pool, size_t id, struct flux_job *job);
+};
+
+struct flux_deque
+{
+	pthread_mutex_t lock;
+	struct flux_job **jobs;
+	size_t head, tail, size;
+};
+
+struct flux_pool
+{
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	struct flux_deque *deque;
+	pthread_t *thread;
+	size_t threads, started, queued, pending;
+	int stop;
+};
+
+struct flux_worker
+{
+	struct flux_pool *pool;
+	size_t id;
+};
+
+size_t flux_pool_threads(size_t threads)
+{
+	if (threads == 0)
+	{
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		threads = cpus > 0 ? (size_t) cpus : 1;
+	}
+	return threads > FLUX_MT_MAX ? FLUX_MT_MAX : threads;
+}
+
+struct flux_job *flux_pool_take(struct flux_pool *pool, size_t id)
+{
+	struct flux_deque *deque;
+	struct flux_job *job = NULL;
+	size_t cnt;
+
+	deque = &pool->deque[id];
+
+	pthread_mutex_lock(&deque->lock);
+
+	if (deque->head != deque->tail)
+	{
+		job = deque->jobs[--deque->tail % deque->size];
+	}
+	pthread_mutex_unlock(&deque->lock);
+
+	for (cnt = 1 ; job == NULL && cnt < pool->threads ; cnt++)
+	{
+		deque = &pool->deque[(id + cnt) % pool->threads];
+
+		pthread_mutex_lock(&deque->lock);
+
+		if (deque->head != deque->tail)
+		{
+			job = deque->jobs[deque->head++ % deque->size];
+		}
+		pthread_mutex_unlock(&deque->lock);
+	}
+
+	if (job)
+	{
+		pthread_mutex_lock(&pool->lock);
+		pool->queued--;
+		pthread_mutex_unlock(&pool->lock);
+	}
+	return job;
+}
+
+// Returns 0 if the job could not be queued, in which case the caller should
+// run it.
+
+int flux_pool_push(struct flux_pool *pool, size_t id, struct flux_job *job)
+{
+	struct flux_deque *deque = &pool->deque[id];
+
+	pthread_mutex_lock(&deque->lock);
+
+	if (deque->tail - deque->head == deque->size)
+	{
+		size_t cnt, size = deque->size ? deque->size * 2 : 64;
+		struct flux_job **jobs = (struct flux_job **) malloc(size * sizeof(struct flux_job *));
+
+		if (jobs == NULL)
+		{
+			pthread_mutex_unlock(&deque->lock);
+			return 0;
+		}
+
+		for (cnt = 0 ; deque->head + cnt != deque->tail ; cnt++)
+		{
+			jobs[cnt] = deque->jobs[(deque->head + cnt) % deque->size];
+		}
+		free(deque->jobs);
+
+		deque->jobs = jobs;
+		deque->size = size;
+		deque->head = 0;
+		deque->tail = cnt;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->pending++;
+	pool->queued++;
+	pthread_mutex_unlock(&pool->lock);
+
+	deque->jobs[deque->tail++ % deque->size] = job;
+
+	pthread_mutex_unlock(&deque->lock);
+
+	pthread_cond_signal(&pool->wake);
+
+	return 1;
+}
+
+void flux_pool_finish(struct flux_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+
+	if (--pool->pending == 0)
+	{
+		pthread_cond_broadcast(&pool->wake);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+// Jobs can belong to a group, a counter that the job decrements with
+// flux_pool_leave() when it is done. This allows a thread to wait for its own
+// jobs while unrelated jobs are still pending.
+
+void flux_pool_leave(struct flux_pool *pool, size_t *group)
+{
+	pthread_mutex_lock(&pool->lock);
+
+	if (--*group == 0)
+	{
+		pthread_cond_broadcast(&pool->wake);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+// Run jobs until the group counter drops to zero.
+
+void flux_pool_wait(struct flux_pool *pool, size_t id, size_t *group)
+{
+	struct flux_job *job;
+
+	while (1)
+	{
+		pthread_mutex_lock(&pool->lock);
+
+		while (*group && pool->queued == 0)
+		{
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		}
+		if (*group == 0)
+		{
+			pthread_mutex_unlock(&pool->lock);
+			return;
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		job = flux_pool_take(pool, id);
+
+		if (job)
+		{
+			job->func(pool, id, job);
+
+			flux_pool_finish(pool);
+		}
+	}
+}
+
+// Run jobs until the pool is stopped, or when wait is set, until all pending
+// jobs have finished.
+
+void flux_pool_work(struct flux_pool *pool, size_t id, int wait)
+{
+	struct flux_job *job;
+
+	while (1)
+	{
+		job = flux_pool_take(pool, id);
+
+		if (job)
+		{
+			job->func(pool, id, job);
+
+			flux_pool_finish(pool);
+
+			continue;
+		}
+
+		pthread_mutex_lock(&pool->lock);
+
+		if (wait)
+		{
+			while (pool->queued == 0 && pool->pending)
+			{
+				pthread_cond_wait(&pool->wake, &pool->lock);
+			}
+			if (pool->pending == 0)
+			{
+				pthread_mutex_unlock(&pool->lock);
+				return;
+			}
+		}
+		else
+		{
+			while (pool->queued == 0 && pool->stop == 0)
+			{
+				pthread_cond_wait(&pool->wake, &pool->lock);
+			}
+			if (pool->stop)
+			{
+				pthread_mutex_unlock(&pool->lock);
+				return;
+			}
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+void *flux_pool_main(void *arg)
+{
+	struct flux_worker *worker = (struct flux_worker *) arg;
+
+	flux_pool_work(worker->pool, worker->id, 0);
+
+	free(worker);
+
+	return NULL;
+}
+
+void flux_pool_destroy(struct flux_pool *pool)
+{
+	size_t cnt;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (cnt = 1 ; cnt < pool->started ; cnt++)
+	{
+		pthread_join(pool->thread[cnt], NULL);
+	}
+
+	for (cnt = 0 ; cnt < pool->threads ; cnt++)
+	{
+		pthread_mutex_destroy(&pool->deque[cnt].lock);
+		free(pool->deque[cnt].jobs);
+	}
+	pthread_cond_destroy(&pool->wake);
+	pthread_mutex_destroy(&pool->lock);
+
+	free(pool->thread);
+	free(pool->deque);
+	free(pool);
+}
+
+// The calling thread becomes worker 0, it only takes part in the work while
+// inside flux_pool_work().
+
+struct flux_pool *flux_pool_create(size_t threads)
+{
+	struct flux_pool *pool;
+	struct flux_worker *worker;
+	size_t cnt;
+
+	pool = (struct flux_pool *) calloc(1, sizeof(struct flux_pool));
+
+	if (pool == NULL)
+	{
+		return NULL;
+	}
+	pool->deque = (struct flux_deque *) calloc(threads, sizeof(struct flux_deque));
+	pool->thread = (pthread_t *) calloc(threads, sizeof(pthread_t));
+
+	if (pool->deque == NULL || pool->thread == NULL)
+	{
+		free(pool->deque);
+		free(pool->thread);
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+
+	for (cnt = 0 ; cnt < threads ; cnt++)
+	{
+		pthread_mutex_init(&pool->deque[cnt].lock, NULL);
+	}
+	pool->threads = threads;
+
+	// if a thread fails to start its deque simply stays empty
+
+	for (pool->started = 1 ; pool->started < threads ; pool->started++)
+	{
+		worker = (struct flux_worker *) malloc(sizeof(struct flux_worker));
+
+		if (worker == NULL)
+		{
+			break;
+		}
+		worker->pool = pool;
+		worker->id = pool->started;
+
+		if (pthread_create(&pool->thread[pool->started], NULL, flux_pool_main, worker))
+		{
+			free(worker);
+			break;
+		}
+	}
+	return pool;
+}
+
+//////////////////////////////////////////////////////////
+// ┌───────────────────────────────────────────────────┐//
+// │       ██████┐ ██████┐    ██████┐ ██████┐████████┐ │//
+// │       └────██┐└────██┐   ██┌──██┐└─██┌─┘└──██┌──┘ │//
+// │        █████┌┘ █████┌┘   ██████┌┘  ██│     ██│    │//
+// │        └───██┐██┌───┘    ██┌──██┐  ██│     ██│    │//
+// │       ██████┌┘███████┐   ██████┌┘██████┐   ██│    │//
+// │       └─────┘ └──────┘   └─────┘ └─────┘   └─┘    │//
+// └───────────────────────────────────────────────────┘//
+//////////////////////////////////////////////////////////
+
+#define VAR int
+#define FUNC(NAME) NAME##32
+
+#include "fluxsort_mt.c"
+
+#undef VAR
+#undef FUNC
+
+//////////////////////////////////////////////////////////
+// ┌───────────────────────────────────────────────────┐//
+// │        █████┐ ██┐  ██┐   ██████┐ ██████┐████████┐ │//
+// │       ██┌───┘ ██│  ██│   ██┌──██┐└─██┌─┘└──██┌──┘ │//
+// │       ██████┐ ███████│   ██████┌┘  ██│     ██│    │//
+// │       ██┌──██┐└────██│   ██┌──██┐  ██│     ██│    │//
+// │       └█████┌┘     ██│   ██████┌┘██████┐   ██│    │//
+// │        └────┘      └─┘   └─────┘ └─────┘   └─┘    │//
+// └───────────────────────────────────────────────────┘//
+//////////////////////////////////////////////////////////
+
+#define VAR long long
+#define FUNC(NAME) NAME##64
+
+#include "fluxsort_mt.c"
+
+#undef VAR
+#undef FUNC
+
+//////////////////////////////////////////////////////////
+//┌────────────────────────────────────────────────────┐//
+//│                █████┐    ██████┐ ██████┐████████┐  │//
+//│               ██┌──██┐   ██┌──██┐└─██┌─┘└──██┌──┘  │//
+//│               └█████┌┘   ██████┌┘  ██│     ██│     │//
+//│               ██┌──██┐   ██┌──██┐  ██│     ██│     │//
+//│               └█████┌┘   ██████┌┘██████┐   ██│     │//
+//│                └────┘    └─────┘ └─────┘   └─┘     │//
+//└────────────────────────────────────────────────────┘//
+//////////////////////////////////////////////////////////
+
+#define VAR char
+#define FUNC(NAME) NAME##8
+
+#include "fluxsort_mt.c"
+
+#undef VAR
+#undef FUNC
+
+//////////////////////////////////////////////////////////
+//┌────────────────────────────────────────────────────┐//
+//│           ▄██┐   █████┐    ██████┐ ██████┐████████┐│//
+//│          ████│  ██┌───┘    ██┌──██┐└─██┌─┘└──██┌──┘│//
+//│          └─██│  ██████┐    ██████┌┘  ██│     ██│   │//
+//│            ██│  ██┌──██┐   ██┌──██┐  ██│     ██│   │//
+//│          ██████┐└█████┌┘   ██████┌┘██████┐   ██│   │//
+//│          └─────┘ └────┘    └─────┘ └─────┘   └─┘   │//
+//└────────────────────────────────────────────────────┘//
+//////////////////////////////////////////////////////////
+
+#define VAR short
+#define FUNC(NAME) NAME##16
+
+#include "fluxsort_mt.c"
+
+#undef VAR
+#undef FUNC
+
+//////////////////////////////////////////////////////////
+//┌────────────────────────────────────────────────────┐//
+//│  ▄██┐  ██████┐  █████┐    ██████┐ ██████┐████████┐ │//
+//│ ████│  └────██┐██┌──██┐   ██┌──██┐└─██┌─┘└──██┌──┘ │//
+//│ └─██│   █████┌┘└█████┌┘   ██████┌┘  ██│     ██│    │//
+//│   ██│  ██┌───┘ ██┌──██┐   ██┌──██┐  ██│     ██│    │//
+//│ ██████┐███████┐└█████┌┘   ██████┌┘██████┐   ██│    │//
+//│ └─────┘└──────┘ └────┘    └─────┘ └─────┘   └─┘    │//
+//└────────────────────────────────────────────────────┘//
+//////////////////////////////////////////////////////////
+
+#if (DBL_MANT_DIG < LDBL_MANT_DIG)
+  #define VAR long double
+  #define FUNC(NAME) NAME##128
+    #include "fluxsort_mt.c"
+  #undef VAR
+  #undef FUNC
+#endif
+
+// Records of 12, 16, 24, 32, and 64 bytes are moved by value, see quadsort.h.
+// A 16 byte record can't use the long double functions, which may only copy
+// the 10 bytes that hold the value.
+
+#ifndef cmp
+
+#define VAR struct96
+#define FUNC(NAME) NAME##_struct96
+
+#include "fluxsort_mt.c"
+
+#undef VAR
+#undef FUNC
+
+#define VAR struct128
+#define FUNC(NAME) NAME##_struct128
+
+#include "fluxsort_mt.c"
+
+#undef VAR
+#undef FUNC
+
+#define VAR struct192
+#define FUNC(NAME) NAME##_struct192
+
+#include "fluxsort_mt.c"
+
+#undef VAR
+#undef FUNC
+
+#define VAR struct256
+#define FUNC(NAME) NAME##_struct256
+
+#include "fluxsort_mt.c"
+
+#undef VAR
+#undef FUNC
+
+#define VAR struct512
+#define FUNC(NAME) NAME##_struct512
+
+#include "fluxsort_mt.c"
+
+#undef VAR
+#undef FUNC
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//┌────────────────────────────────────────────────────────────────────┐//
+//│███████┐██┐     ██┐   ██┐██┐  ██┐███████┐ ██████┐ ██████┐ ████████┐ │//
+//│██┌────┘██│     ██│   ██│└██┐██┌┘██┌────┘██┌───██┐██┌──██┐└──██┌──┘ │//
+//│█████┐  ██│     ██│   ██│ └███┌┘ ███████┐██│   ██│██████┌┘   ██│    │//
+//│██┌──┘  ██│     ██│   ██│ ██┌██┐ └────██│██│   ██│██┌──██┐   ██│    │//
+//│██│     ███████┐└██████┌┘██┌┘ ██┐███████│└██████┌┘██│  ██│   ██│    │//
+//│└─┘     └──────┘ └─────┘ └─┘  └─┘└──────┘ └─────┘ └─┘  └─┘   └─┘    │//
+//└────────────────────────────────────────────────────────────────────┘//
+//////////////////////////////////////////////////////////////////////////
+
+// Threads is the number of threads to use, including the calling thread, 0
+// uses one thread per online cpu. Record sizes without an instantiation are
+// sorted by fluxsort() with a single thread, its comparison function wrapper
+// is per thread.
+
+void fluxsort_mt(void *array, size_t nmemb, size_t size, CMPFUNC *cmp, size_t threads)
+{
+	if (nmemb < 2)
+	{
+		return;
+	}
+
+	threads = flux_pool_threads(threads);
+
+	switch (size)
+	{
+		case sizeof(char):
+			fluxsort_mt8(array, nmemb, cmp, threads);
+			return;
+
+		case sizeof(short):
+			fluxsort_mt16(array, nmemb, cmp, threads);
+			return;
+
+		case sizeof(int):
+			fluxsort_mt32(array, nmemb, cmp, threads);
+			return;
+
+		case sizeof(long long):
+			fluxsort_mt64(array, nmemb, cmp, threads);
+			return;
+#ifndef cmp
+		case sizeof(struct96):
+			fluxsort_mt_struct96(array, nmemb, cmp, threads);
+			return;
+
+		case sizeof(struct128):
+			fluxsort_mt_struct128(array, nmemb, cmp, threads);
+			return;
+
+		case sizeof(struct192):
+			fluxsort_mt_struct192(array, nmemb, cmp, threads);
+			return;
+
+		case sizeof(struct256):
+			fluxsort_mt_struct256(array, nmemb, cmp, threads);
+			return;
+
+		case sizeof(struct512):
+			fluxsort_mt_struct512(array, nmemb, cmp, threads);
+			return;
+
+		default:
+			fluxsort(array, nmemb, size, cmp);
+#else
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+		case sizeof(long double):
+			fluxsort_mt128(array, nmemb, cmp, threads);
+			return;
+  #endif
+
+		default:
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long) || size == sizeof(long double));
+  #else
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long));
+  #endif
+#endif
+	}
+}
+
+// Sorts blocks with quadsort and merges them in parallel using merge path.
+// Record sizes without an instantiation are sorted by quadsort().
+
+void quadsort_mt(void *array, size_t nmemb, size_t size, CMPFUNC *cmp, size_t threads)
+{
+	if (nmemb < 2)
+	{
+		return;
+	}
+
+	threads = flux_pool_threads(threads);
+
+	switch (size)
+	{
+		case sizeof(char):
+			quadsort_mt8(array, nmemb, cmp, threads);
+			return;
+
+		case sizeof(short):
+			quadsort_mt16(array, nmemb, cmp, threads);
+			return;
+
+		case sizeof(int):
+			quadsort_mt32(array, nmemb, cmp, threads);
+			return;
+
+		case sizeof(long long):
+			quadsort_mt64(array, nmemb, cmp, threads);
+			return;
+#ifndef cmp
+		case sizeof(struct96):
+			quadsort_mt_struct96(array, nmemb, cmp, threads);
+			return;
+
+		case sizeof(struct128):
+			quadsort_mt_struct128(array, nmemb, cmp, threads);
+			return;
+
+		case sizeof(struct192):
+			quadsort_mt_struct192(array, nmemb, cmp, threads);
+			return;
+
+		case sizeof(struct256):
+			quadsort_mt_struct256(array, nmemb, cmp, threads);
+			return;
+
+		case sizeof(struct512):
+			quadsort_mt_struct512(array, nmemb, cmp, threads);
+			return;
+
+		default:
+			quadsort(array, nmemb, size, cmp);
+#else
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+		case sizeof(long double):
+			quadsort_mt128(array, nmemb, cmp, threads);
+			return;
+  #endif
+
+		default:
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long) || size == sizeof(long double));
+  #else
+			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long));
+  #endif
+#endif
+	}
+}
+
+#endif
@@ -0,0 +1,951 @@
+// fluxsort_simd 1.2.1.3 - Igor van den Hoven ivdhoven@gmail.com
+
+// Vectorized partition kernels for fluxsort_prim(). Each vector is compared
+// against the pivot, after which the elements that go to array and the
+// elements that go to swap are packed in order, so the partition remains
+// stable. AVX-512 uses compress stores, AVX2 and SSE4.2 use permutation
+// tables. Small arrays are sorted by AVX2 sorting networks in tail_swap(),
+// and large runs are merged by bitonic merge networks in twin_merge().
+
+// Every kernel is compiled for its own target, the best kernel set supported
+// by the cpu is picked at runtime, so a single binary uses AVX2 or AVX-512
+// where available. FLUX_SIMD_MAX can be defined to cap the kernel set.
+
+#ifndef FLUXSORT_SIMD_H
+#define FLUXSORT_SIMD_H
+
+#if (defined __GNUC__ || defined __clang__) && (defined __x86_64__ || defined __i386__)
+
+#include <immintrin.h>
+#include <limits.h>
+#include <string.h>
+
+#define FLUX_SIMD
+
+#define FLUX_SCALAR 0
+#define FLUX_SSE42  1
+#define FLUX_AVX2   2
+#define FLUX_AVX512 3
+
+#ifndef FLUX_SIMD_MAX
+  #define FLUX_SIMD_MAX FLUX_AVX512
+#endif
+
+#define FLUX_TARGET_SSE42  __attribute__ ((target ("sse4.2,popcnt")))
+#define FLUX_TARGET_AVX2   __attribute__ ((target ("avx2,popcnt")))
+#define FLUX_TARGET_AVX512 __attribute__ ((target ("avx512f,popcnt")))
+
+// the cpu is checked on the first call, the result is cached
+
+int flux_simd_level(void)
+{
+	static int level = -1;
+	int cpu = __atomic_load_n(&level, __ATOMIC_RELAXED);
+
+	if (cpu < 0)
+	{
+		__builtin_cpu_init();
+
+		if (__builtin_cpu_supports("avx512f"))
+		{
+			cpu = FLUX_AVX512;
+		}
+		else if (__builtin_cpu_supports("avx2"))
+		{
+			cpu = FLUX_AVX2;
+		}
+		else if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+		{
+			cpu = FLUX_SSE42;
+		}
+		else
+		{
+			cpu = FLUX_SCALAR;
+		}
+		cpu = cpu < FLUX_SIMD_MAX ? cpu : FLUX_SIMD_MAX;
+
+		__atomic_store_n(&level, cpu, __ATOMIC_RELAXED);
+	}
+	return cpu;
+}
+
+// Entry n holds the indices of the set bits of n in nibbles, followed by the
+// indices of the clear bits.
+
+const unsigned int flux_simd_table[256] =
+{
+	0x76543210, 0x76543210, 0x76543201, 0x76543210, 0x76543102, 0x76543120, 0x76543021, 0x76543210,
+	0x76542103, 0x76542130, 0x76542031, 0x76542310, 0x76541032, 0x76541320, 0x76540321, 0x76543210,
+	0x76532104, 0x76532140, 0x76532041, 0x76532410, 0x76531042, 0x76531420, 0x76530421, 0x76534210,
+	0x76521043, 0x76521430, 0x76520431, 0x76524310, 0x76510432, 0x76514320, 0x76504321, 0x76543210,
+	0x76432105, 0x76432150, 0x76432051, 0x76432510, 0x76431052, 0x76431520, 0x76430521, 0x76435210,
+	0x76421053, 0x76421530, 0x76420531, 0x76425310, 0x76410532, 0x76415320, 0x76405321, 0x76453210,
+	0x76321054, 0x76321540, 0x76320541, 0x76325410, 0x76310542, 0x76315420, 0x76305421, 0x76354210,
+	0x76210543, 0x76215430, 0x76205431, 0x76254310, 0x76105432, 0x76154320, 0x76054321, 0x76543210,
+	0x75432106, 0x75432160, 0x75432061, 0x75432610, 0x75431062, 0x75431620, 0x75430621, 0x75436210,
+	0x75421063, 0x75421630, 0x75420631, 0x75426310, 0x75410632, 0x75416320, 0x75406321, 0x75463210,
+	0x75321064, 0x75321640, 0x75320641, 0x75326410, 0x75310642, 0x75316420, 0x75306421, 0x75364210,
+	0x75210643, 0x75216430, 0x75206431, 0x75264310, 0x75106432, 0x75164320, 0x75064321, 0x75643210,
+	0x74321065, 0x74321650, 0x74320651, 0x74326510, 0x74310652, 0x74316520, 0x74306521, 0x74365210,
+	0x74210653, 0x74216530, 0x74206531, 0x74265310, 0x74106532, 0x74165320, 0x74065321, 0x74653210,
+	0x73210654, 0x73216540, 0x73206541, 0x73265410, 0x73106542, 0x73165420, 0x73065421, 0x73654210,
+	0x72106543, 0x72165430, 0x72065431, 0x72654310, 0x71065432, 0x71654320, 0x70654321, 0x76543210,
+	0x65432107, 0x65432170, 0x65432071, 0x65432710, 0x65431072, 0x65431720, 0x65430721, 0x65437210,
+	0x65421073, 0x65421730, 0x65420731, 0x65427310, 0x65410732, 0x65417320, 0x65407321, 0x65473210,
+	0x65321074, 0x65321740, 0x65320741, 0x65327410, 0x65310742, 0x65317420, 0x65307421, 0x65374210,
+	0x65210743, 0x65217430, 0x65207431, 0x65274310, 0x65107432, 0x65174320, 0x65074321, 0x65743210,
+	0x64321075, 0x64321750, 0x64320751, 0x64327510, 0x64310752, 0x64317520, 0x64307521, 0x64375210,
+	0x64210753, 0x64217530, 0x64207531, 0x64275310, 0x64107532, 0x64175320, 0x64075321, 0x64753210,
+	0x63210754, 0x63217540, 0x63207541, 0x63275410, 0x63107542, 0x63175420, 0x63075421, 0x63754210,
+	0x62107543, 0x62175430, 0x62075431, 0x62754310, 0x61075432, 0x61754320, 0x60754321, 0x67543210,
+	0x54321076, 0x54321760, 0x54320761, 0x54327610, 0x54310762, 0x54317620, 0x54307621, 0x54376210,
+	0x54210763, 0x54217630, 0x54207631, 0x54276310, 0x54107632, 0x54176320, 0x54076321, 0x54763210,
+	0x53210764, 0x53217640, 0x53207641, 0x53276410, 0x53107642, 0x53176420, 0x53076421, 0x53764210,
+	0x52107643, 0x52176430, 0x52076431, 0x52764310, 0x51076432, 0x51764320, 0x50764321, 0x57643210,
+	0x43210765, 0x43217650, 0x43207651, 0x43276510, 0x43107652, 0x43176520, 0x43076521, 0x43765210,
+	0x42107653, 0x42176530, 0x42076531, 0x42765310, 0x41076532, 0x41765320, 0x40765321, 0x47653210,
+	0x32107654, 0x32176540, 0x32076541, 0x32765410, 0x31076542, 0x31765420, 0x30765421, 0x37654210,
+	0x21076543, 0x21765430, 0x20765431, 0x27654310, 0x10765432, 0x17654320, 0x07654321, 0x76543210,
+};
+
+// The same for four 32 bit lanes, as byte shuffles.
+
+const unsigned char flux_simd_shuffle[16][16] =
+{
+	{ 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+	{ 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+	{ 4,  5,  6,  7,  0,  1,  2,  3,  8,  9, 10, 11, 12, 13, 14, 15},
+	{ 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+	{ 8,  9, 10, 11,  0,  1,  2,  3,  4,  5,  6,  7, 12, 13, 14, 15},
+	{ 0,  1,  2,  3,  8,  9, 10, 11,  4,  5,  6,  7, 12, 13, 14, 15},
+	{ 4,  5,  6,  7,  8,  9, 10, 11,  0,  1,  2,  3, 12, 13, 14, 15},
+	{ 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+	{12, 13, 14, 15,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11},
+	{ 0,  1,  2,  3, 12, 13, 14, 15,  4,  5,  6,  7,  8,  9, 10, 11},
+	{ 4,  5,  6,  7, 12, 13, 14, 15,  0,  1,  2,  3,  8,  9, 10, 11},
+	{ 0,  1,  2,  3,  4,  5,  6,  7, 12, 13, 14, 15,  8,  9, 10, 11},
+	{ 8,  9, 10, 11, 12, 13, 14, 15,  0,  1,  2,  3,  4,  5,  6,  7},
+	{ 0,  1,  2,  3,  8,  9, 10, 11, 12, 13, 14, 15,  4,  5,  6,  7},
+	{ 4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,  0,  1,  2,  3},
+	{ 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+};
+
+// With reverse set elements smaller than the pivot go to array, otherwise
+// elements smaller or equal to the pivot go to array. Unsigned integers are
+// compared as signed integers by flipping the sign bit.
+
+// Elements are partitioned in groups of 8, the number of elements processed
+// is returned, m is set to the number of elements that went to array, and run
+// is set the same way flux_default_partition() sets it. The kernels that
+// store full vectors leave the last group to the caller, so the unused lanes
+// are never written past the end of the partition.
+
+FLUX_TARGET_AVX512
+size_t flux_avx512_split32(int *array, int *swap, int *ptx, int piv, size_t nmemb, int reverse, size_t *m, size_t *run, int flip)
+{
+	__m512i vf = _mm512_set1_epi32(flip), vp, v;
+	size_t a, s = 0;
+	__mmask16 mask;
+
+	vp = _mm512_xor_si512(_mm512_set1_epi32(piv), vf);
+
+	for (a = 16 ; a <= nmemb ; a += 16)
+	{
+		v = _mm512_loadu_si512(ptx); ptx += 16;
+
+		mask = reverse ? _mm512_cmpge_epi32_mask(_mm512_xor_si512(v, vf), vp) : _mm512_cmpgt_epi32_mask(_mm512_xor_si512(v, vf), vp);
+
+		_mm512_mask_compressstoreu_epi32(array + a - 16 - s, (__mmask16) ~mask, v);
+		_mm512_mask_compressstoreu_epi32(swap + s, mask, v);
+
+		s += __builtin_popcount(mask);
+
+		if (s == 0) *run = a;
+	}
+	a -= 16;
+	*m = a - s;
+
+	return a;
+}
+
+FLUX_TARGET_AVX512
+size_t flux_avx512_split64(long long *array, long long *swap, long long *ptx, long long piv, size_t nmemb, int reverse, size_t *m, size_t *run, long long flip)
+{
+	__m512i vf = _mm512_set1_epi64(flip), vp, v;
+	size_t a, s = 0;
+	__mmask8 mask;
+
+	vp = _mm512_xor_si512(_mm512_set1_epi64(piv), vf);
+
+	for (a = 8 ; a <= nmemb ; a += 8)
+	{
+		v = _mm512_loadu_si512(ptx); ptx += 8;
+
+		mask = reverse ? _mm512_cmpge_epi64_mask(_mm512_xor_si512(v, vf), vp) : _mm512_cmpgt_epi64_mask(_mm512_xor_si512(v, vf), vp);
+
+		_mm512_mask_compressstoreu_epi64(array + a - 8 - s, (__mmask8) ~mask, v);
+		_mm512_mask_compressstoreu_epi64(swap + s, mask, v);
+
+		s += __builtin_popcount(mask);
+
+		if (s == 0) *run = a;
+	}
+	a -= 8;
+	*m = a - s;
+
+	return a;
+}
+
+#define flux_avx2_perm(mask) \
+	_mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32(flux_simd_table[mask]), _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28)), _mm256_set1_epi32(15))
+
+// The movemask of a 64 bit compare sets two bits per lane, so a 64 bit lane
+// moves as two 32 bit lanes and the 32 bit tables can be used.
+
+#define flux_avx2_split(compare, ms) \
+{ \
+	vc = reverse ? compare(vp, _mm256_xor_si256(v, vf)) : compare(_mm256_xor_si256(v, vf), vp); \
+	mask = _mm256_movemask_ps(_mm256_castsi256_ps(vc)) ^ (reverse ? 255 : 0); \
+	_mm256_storeu_si256((__m256i *) (pta), _mm256_permutevar8x32_epi32(v, flux_avx2_perm(mask ^ 255))); \
+	_mm256_storeu_si256((__m256i *) (pts), _mm256_permutevar8x32_epi32(v, flux_avx2_perm(mask))); \
+	mask = __builtin_popcount(mask) / ms; \
+	pts += mask; pta += 8 / ms - mask; \
+}
+
+FLUX_TARGET_AVX2
+size_t flux_avx2_split32(int *array, int *swap, int *ptx, int piv, size_t nmemb, int reverse, size_t *m, size_t *run, int flip)
+{
+	__m256i vf = _mm256_set1_epi32(flip), vp, vc, v;
+	int *pta = array, *pts = swap;
+	unsigned int mask;
+	size_t a;
+
+	vp = _mm256_xor_si256(_mm256_set1_epi32(piv), vf);
+
+	for (a = 8 ; a + 8 <= nmemb ; a += 8)
+	{
+		v = _mm256_loadu_si256((__m256i *) ptx); flux_avx2_split(_mm256_cmpgt_epi32, 1); ptx += 8;
+
+		if (pts == swap) *run = a;
+	}
+	*m = pta - array;
+
+	return a - 8;
+}
+
+FLUX_TARGET_AVX2
+size_t flux_avx2_split64(long long *array, long long *swap, long long *ptx, long long piv, size_t nmemb, int reverse, size_t *m, size_t *run, long long flip)
+{
+	__m256i vf = _mm256_set1_epi64x(flip), vp, vc, v;
+	long long *pta = array, *pts = swap;
+	unsigned int mask;
+	size_t a;
+
+	vp = _mm256_xor_si256(_mm256_set1_epi64x(piv), vf);
+
+	for (a = 8 ; a + 8 <= nmemb ; a += 8)
+	{
+		v = _mm256_loadu_si256((__m256i *) ptx); flux_avx2_split(_mm256_cmpgt_epi64, 2); ptx += 4;
+		v = _mm256_loadu_si256((__m256i *) ptx); flux_avx2_split(_mm256_cmpgt_epi64, 2); ptx += 4;
+
+		if (pts == swap) *run = a;
+	}
+	*m = pta - array;
+
+	return a - 8;
+}
+
+#define flux_sse42_split(compare, ms) \
+{ \
+	vc = reverse ? compare(vp, _mm_xor_si128(v, vf)) : compare(_mm_xor_si128(v, vf), vp); \
+	mask = _mm_movemask_ps(_mm_castsi128_ps(vc)) ^ (reverse ? 15 : 0); \
+	_mm_storeu_si128((__m128i *) (pta), _mm_shuffle_epi8(v, _mm_loadu_si128((__m128i *) flux_simd_shuffle[mask ^ 15]))); \
+	_mm_storeu_si128((__m128i *) (pts), _mm_shuffle_epi8(v, _mm_loadu_si128((__m128i *) flux_simd_shuffle[mask]))); \
+	mask = __builtin_popcount(mask) / ms; \
+	pts += mask; pta += 4 / ms - mask; \
+}
+
+FLUX_TARGET_SSE42
+size_t flux_sse42_split32(int *array, int *swap, int *ptx, int piv, size_t nmemb, int reverse, size_t *m, size_t *run, int flip)
+{
+	__m128i vf = _mm_set1_epi32(flip), vp, vc, v;
+	int *pta = array, *pts = swap;
+	unsigned int mask;
+	size_t a;
+
+	vp = _mm_xor_si128(_mm_set1_epi32(piv), vf);
+
+	for (a = 8 ; a + 8 <= nmemb ; a += 8)
+	{
+		v = _mm_loadu_si128((__m128i *) ptx); flux_sse42_split(_mm_cmpgt_epi32, 1); ptx += 4;
+		v = _mm_loadu_si128((__m128i *) ptx); flux_sse42_split(_mm_cmpgt_epi32, 1); ptx += 4;
+
+		if (pts == swap) *run = a;
+	}
+	*m = pta - array;
+
+	return a - 8;
+}
+
+FLUX_TARGET_SSE42
+size_t flux_sse42_split64(long long *array, long long *swap, long long *ptx, long long piv, size_t nmemb, int reverse, size_t *m, size_t *run, long long flip)
+{
+	__m128i vf = _mm_set1_epi64x(flip), vp, vc, v;
+	long long *pta = array, *pts = swap;
+	unsigned int mask;
+	size_t a;
+
+	vp = _mm_xor_si128(_mm_set1_epi64x(piv), vf);
+
+	for (a = 8 ; a + 8 <= nmemb ; a += 8)
+	{
+		v = _mm_loadu_si128((__m128i *) ptx); flux_sse42_split(_mm_cmpgt_epi64, 2); ptx += 2;
+		v = _mm_loadu_si128((__m128i *) ptx); flux_sse42_split(_mm_cmpgt_epi64, 2); ptx += 2;
+		v = _mm_loadu_si128((__m128i *) ptx); flux_sse42_split(_mm_cmpgt_epi64, 2); ptx += 2;
+		v = _mm_loadu_si128((__m128i *) ptx); flux_sse42_split(_mm_cmpgt_epi64, 2); ptx += 2;
+
+		if (pts == swap) *run = a;
+	}
+	*m = pta - array;
+
+	return a - 8;
+}
+
+// The scalar kernel set leaves everything to the caller.
+
+size_t flux_simd_split32(int *array, int *swap, int *ptx, int piv, size_t nmemb, int reverse, size_t *m, size_t *run, int flip)
+{
+	switch (flux_simd_level())
+	{
+		case FLUX_AVX512:
+			return flux_avx512_split32(array, swap, ptx, piv, nmemb, reverse, m, run, flip);
+		case FLUX_AVX2:
+			return flux_avx2_split32(array, swap, ptx, piv, nmemb, reverse, m, run, flip);
+		case FLUX_SSE42:
+			return flux_sse42_split32(array, swap, ptx, piv, nmemb, reverse, m, run, flip);
+	}
+	*m = 0;
+
+	return 0;
+}
+
+size_t flux_simd_split64(long long *array, long long *swap, long long *ptx, long long piv, size_t nmemb, int reverse, size_t *m, size_t *run, long long flip)
+{
+	switch (flux_simd_level())
+	{
+		case FLUX_AVX512:
+			return flux_avx512_split64(array, swap, ptx, piv, nmemb, reverse, m, run, flip);
+		case FLUX_AVX2:
+			return flux_avx2_split64(array, swap, ptx, piv, nmemb, reverse, m, run, flip);
+		case FLUX_SSE42:
+			return flux_sse42_split64(array, swap, ptx, piv, nmemb, reverse, m, run, flip);
+	}
+	*m = 0;
+
+	return 0;
+}
+
+// Sorting networks for tail_swap() of the primitive instantiations. Up to 128
+// elements are padded with the largest value to a power of two vectors. The
+// columns of every 8x8 (4x4 for 64 bit) block are sorted with a sorting
+// network, after which the block is transposed so every vector is sorted.
+// The vectors are then merged with bitonic merges, the last three (two for
+// 64 bit) steps of which take place within a vector. Stability is of no
+// concern since equal primitives can't be told apart.
+
+#define flux_avx2_minmax32(a, b) \
+{ \
+	vt = _mm256_min_epi32(a, b); b = _mm256_max_epi32(a, b); a = vt; \
+}
+
+#define flux_avx2_minmax64(a, b) \
+{ \
+	vc = _mm256_cmpgt_epi64(a, b); vt = _mm256_blendv_epi8(a, b, vc); b = _mm256_blendv_epi8(b, a, vc); a = vt; \
+}
+
+// sorts v[0..k * 2) when v[0..k) and v[k..k * 2) are sorted
+
+FLUX_TARGET_AVX2
+void flux_avx2_merge32(__m256i *v, size_t k)
+{
+	__m256i vt, vr = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	size_t i, d;
+
+	for (i = 0 ; i < k / 2 ; i++)
+	{
+		vt = v[k + i]; v[k + i] = v[k * 2 - 1 - i]; v[k * 2 - 1 - i] = vt;
+	}
+
+	for (i = 0 ; i < k ; i++)
+	{
+		v[k + i] = _mm256_permutevar8x32_epi32(v[k + i], vr);
+
+		flux_avx2_minmax32(v[i], v[k + i]);
+	}
+
+	for (d = k / 2 ; d ; d /= 2)
+	{
+		for (i = 0 ; i < k * 2 ; i++)
+		{
+			if ((i & d) == 0)
+			{
+				flux_avx2_minmax32(v[i], v[i + d]);
+			}
+		}
+	}
+
+	for (i = 0 ; i < k * 2 ; i++)
+	{
+		vt = _mm256_permute2x128_si256(v[i], v[i], 1);
+		v[i] = _mm256_blend_epi32(_mm256_min_epi32(v[i], vt), _mm256_max_epi32(v[i], vt), 0xF0);
+
+		vt = _mm256_shuffle_epi32(v[i], _MM_SHUFFLE(1, 0, 3, 2));
+		v[i] = _mm256_blend_epi32(_mm256_min_epi32(v[i], vt), _mm256_max_epi32(v[i], vt), 0xCC);
+
+		vt = _mm256_shuffle_epi32(v[i], _MM_SHUFFLE(2, 3, 0, 1));
+		v[i] = _mm256_blend_epi32(_mm256_min_epi32(v[i], vt), _mm256_max_epi32(v[i], vt), 0xAA);
+	}
+}
+
+FLUX_TARGET_AVX2
+void flux_avx2_merge64(__m256i *v, size_t k)
+{
+	__m256i vt, vc, vm;
+	size_t i, d;
+
+	for (i = 0 ; i < k / 2 ; i++)
+	{
+		vt = v[k + i]; v[k + i] = v[k * 2 - 1 - i]; v[k * 2 - 1 - i] = vt;
+	}
+
+	for (i = 0 ; i < k ; i++)
+	{
+		v[k + i] = _mm256_permute4x64_epi64(v[k + i], _MM_SHUFFLE(0, 1, 2, 3));
+
+		flux_avx2_minmax64(v[i], v[k + i]);
+	}
+
+	for (d = k / 2 ; d ; d /= 2)
+	{
+		for (i = 0 ; i < k * 2 ; i++)
+		{
+			if ((i & d) == 0)
+			{
+				flux_avx2_minmax64(v[i], v[i + d]);
+			}
+		}
+	}
+
+	for (i = 0 ; i < k * 2 ; i++)
+	{
+		vt = _mm256_permute4x64_epi64(v[i], _MM_SHUFFLE(1, 0, 3, 2));
+		vc = _mm256_cmpgt_epi64(v[i], vt);
+		vm = _mm256_blendv_epi8(v[i], vt, vc);
+		v[i] = _mm256_blend_epi32(vm, _mm256_blendv_epi8(vt, v[i], vc), 0xF0);
+
+		vt = _mm256_permute4x64_epi64(v[i], _MM_SHUFFLE(2, 3, 0, 1));
+		vc = _mm256_cmpgt_epi64(v[i], vt);
+		vm = _mm256_blendv_epi8(v[i], vt, vc);
+		v[i] = _mm256_blend_epi32(vm, _mm256_blendv_epi8(vt, v[i], vc), 0xCC);
+	}
+}
+
+FLUX_TARGET_AVX2
+void flux_avx2_sort32(int *array, size_t nmemb, int flip)
+{
+	__m256i v[16], vt, t[8], vf = _mm256_set1_epi32(flip);
+	int buf[128];
+	size_t i, j, k = nmemb <= 64 ? 8 : 16;
+
+	memcpy(buf, array, nmemb * sizeof(int));
+
+	for (i = nmemb ; i < k * 8 ; i++)
+	{
+		buf[i] = INT_MAX ^ flip;
+	}
+
+	for (i = 0 ; i < k ; i++)
+	{
+		v[i] = _mm256_xor_si256(_mm256_loadu_si256((__m256i *) (buf + i * 8)), vf);
+	}
+
+	for (i = 0 ; i < k ; i += 8)
+	{
+		__m256i *w = v + i;
+
+		flux_avx2_minmax32(w[0], w[2]); flux_avx2_minmax32(w[1], w[3]); flux_avx2_minmax32(w[4], w[6]); flux_avx2_minmax32(w[5], w[7]);
+		flux_avx2_minmax32(w[0], w[4]); flux_avx2_minmax32(w[1], w[5]); flux_avx2_minmax32(w[2], w[6]); flux_avx2_minmax32(w[3], w[7]);
+		flux_avx2_minmax32(w[0], w[1]); flux_avx2_minmax32(w[2], w[3]); flux_avx2_minmax32(w[4], w[5]); flux_avx2_minmax32(w[6], w[7]);
+		flux_avx2_minmax32(w[2], w[4]); flux_avx2_minmax32(w[3], w[5]);
+		flux_avx2_minmax32(w[1], w[4]); flux_avx2_minmax32(w[3], w[6]);
+		flux_avx2_minmax32(w[1], w[2]); flux_avx2_minmax32(w[3], w[4]); flux_avx2_minmax32(w[5], w[6]);
+
+		t[0] = _mm256_unpacklo_epi32(w[0], w[1]); t[1] = _mm256_unpackhi_epi32(w[0], w[1]);
+		t[2] = _mm256_unpacklo_epi32(w[2], w[3]); t[3] = _mm256_unpackhi_epi32(w[2], w[3]);
+		t[4] = _mm256_unpacklo_epi32(w[4], w[5]); t[5] = _mm256_unpackhi_epi32(w[4], w[5]);
+		t[6] = _mm256_unpacklo_epi32(w[6], w[7]); t[7] = _mm256_unpackhi_epi32(w[6], w[7]);
+
+		w[0] = _mm256_unpacklo_epi64(t[0], t[2]); w[1] = _mm256_unpackhi_epi64(t[0], t[2]);
+		w[2] = _mm256_unpacklo_epi64(t[1], t[3]); w[3] = _mm256_unpackhi_epi64(t[1], t[3]);
+		w[4] = _mm256_unpacklo_epi64(t[4], t[6]); w[5] = _mm256_unpackhi_epi64(t[4], t[6]);
+		w[6] = _mm256_unpacklo_epi64(t[5], t[7]); w[7] = _mm256_unpackhi_epi64(t[5], t[7]);
+
+		t[0] = _mm256_permute2x128_si256(w[0], w[4], 0x20); t[4] = _mm256_permute2x128_si256(w[0], w[4], 0x31);
+		t[1] = _mm256_permute2x128_si256(w[1], w[5], 0x20); t[5] = _mm256_permute2x128_si256(w[1], w[5], 0x31);
+		t[2] = _mm256_permute2x128_si256(w[2], w[6], 0x20); t[6] = _mm256_permute2x128_si256(w[2], w[6], 0x31);
+		t[3] = _mm256_permute2x128_si256(w[3], w[7], 0x20); t[7] = _mm256_permute2x128_si256(w[3], w[7], 0x31);
+
+		memcpy(w, t, sizeof(t));
+	}
+
+	for (j = 1 ; j < k ; j *= 2)
+	{
+		for (i = 0 ; i < k ; i += j * 2)
+		{
+			flux_avx2_merge32(v + i, j);
+		}
+	}
+
+	for (i = 0 ; i < k ; i++)
+	{
+		_mm256_storeu_si256((__m256i *) (buf + i * 8), _mm256_xor_si256(v[i], vf));
+	}
+	memcpy(array, buf, nmemb * sizeof(int));
+}
+
+FLUX_TARGET_AVX2
+void flux_avx2_sort64(long long *array, size_t nmemb, long long flip)
+{
+	__m256i v[32], vt, vc, t[4], vf = _mm256_set1_epi64x(flip);
+	long long buf[128];
+	size_t i, j, k = nmemb <= 32 ? 8 : nmemb <= 64 ? 16 : 32;
+
+	memcpy(buf, array, nmemb * sizeof(long long));
+
+	for (i = nmemb ; i < k * 4 ; i++)
+	{
+		buf[i] = LLONG_MAX ^ flip;
+	}
+
+	for (i = 0 ; i < k ; i++)
+	{
+		v[i] = _mm256_xor_si256(_mm256_loadu_si256((__m256i *) (buf + i * 4)), vf);
+	}
+
+	for (i = 0 ; i < k ; i += 4)
+	{
+		__m256i *w = v + i;
+
+		flux_avx2_minmax64(w[0], w[1]); flux_avx2_minmax64(w[2], w[3]);
+		flux_avx2_minmax64(w[0], w[2]); flux_avx2_minmax64(w[1], w[3]);
+		flux_avx2_minmax64(w[1], w[2]);
+
+		t[0] = _mm256_unpacklo_epi64(w[0], w[1]); t[1] = _mm256_unpackhi_epi64(w[0], w[1]);
+		t[2] = _mm256_unpacklo_epi64(w[2], w[3]); t[3] = _mm256_unpackhi_epi64(w[2], w[3]);
+
+		w[0] = _mm256_permute2x128_si256(t[0], t[2], 0x20); w[2] = _mm256_permute2x128_si256(t[0], t[2], 0x31);
+		w[1] = _mm256_permute2x128_si256(t[1], t[3], 0x20); w[3] = _mm256_permute2x128_si256(t[1], t[3], 0x31);
+	}
+
+	for (j = 1 ; j < k ; j *= 2)
+	{
+		for (i = 0 ; i < k ; i += j * 2)
+		{
+			flux_avx2_merge64(v + i, j);
+		}
+	}
+
+	for (i = 0 ; i < k ; i++)
+	{
+		_mm256_storeu_si256((__m256i *) (buf + i * 4), _mm256_xor_si256(v[i], vf));
+	}
+	memcpy(array, buf, nmemb * sizeof(long long));
+}
+
+// Returns 0 if the cpu lacks AVX2 or nmemb is out of range, in which case
+// the caller should sort the array.
+
+int flux_simd_sort_int32(int *array, size_t nmemb)
+{
+	if (nmemb <= 16 || nmemb > 128 || flux_simd_level() < FLUX_AVX2)
+	{
+		return 0;
+	}
+	flux_avx2_sort32(array, nmemb, 0);
+
+	return 1;
+}
+
+int flux_simd_sort_uint32(unsigned int *array, size_t nmemb)
+{
+	if (nmemb <= 16 || nmemb > 128 || flux_simd_level() < FLUX_AVX2)
+	{
+		return 0;
+	}
+	flux_avx2_sort32((int *) array, nmemb, INT_MIN);
+
+	return 1;
+}
+
+int flux_simd_sort_int64(long long *array, size_t nmemb)
+{
+	if (nmemb <= 16 || nmemb > 128 || flux_simd_level() < FLUX_AVX2)
+	{
+		return 0;
+	}
+	flux_avx2_sort64(array, nmemb, 0);
+
+	return 1;
+}
+
+int flux_simd_sort_uint64(unsigned long long *array, size_t nmemb)
+{
+	if (nmemb <= 16 || nmemb > 128 || flux_simd_level() < FLUX_AVX2)
+	{
+		return 0;
+	}
+	flux_avx2_sort64((long long *) array, nmemb, LLONG_MIN);
+
+	return 1;
+}
+
+// Vectorized merge for twin_merge() and parity_merge() of the primitive
+// instantiations. Like parity_merge() the runs are merged from both ends,
+// 16 elements at a time: the next block is taken from the run with the
+// smaller head (larger tail), merged with the 16 elements left over from
+// the previous step by a bitonic merge, and the lower (upper) half is
+// written out. Once a run can't supply a full block the merge path of
+// both ends is looked up and the middle is merged one element at a time.
+
+size_t flux_simd_corank32(int *ptl, int *ptr, size_t left, size_t right, size_t k, int flip)
+{
+	size_t mid, lo = k > right ? k - right : 0, hi = k < left ? k : left;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+
+		if ((ptl[mid] ^ flip) <= (ptr[k - mid - 1] ^ flip))
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+size_t flux_simd_corank64(long long *ptl, long long *ptr, size_t left, size_t right, size_t k, long long flip)
+{
+	size_t mid, lo = k > right ? k - right : 0, hi = k < left ? k : left;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+
+		if ((ptl[mid] ^ flip) <= (ptr[k - mid - 1] ^ flip))
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+// Both ends are merged until the next block can't be loaded or the ends are
+// about to meet. LOAD(v, pta) loads a block into v[0..hi), MERGE sorts
+// v[0..hi * 2), and STORE(ptd, v) stores a block.
+
+#define flux_simd_twin(VAR, MERGE, LOAD, STORE, hi, corank) \
+{ \
+	VAR *pta, *tpa, *ptb, *tpb, *ptd; \
+	size_t a, b, head, tail, nmemb = left + right; \
+ \
+	LOAD(v, ptl); LOAD((v + hi), ptr); \
+ \
+	a = b = head = 16; \
+ \
+	while (1) \
+	{ \
+		MERGE; \
+		STORE(dest + head - 16, v); \
+ \
+		if (head + 16 > nmemb / 2 || a == left || b == right) \
+		{ \
+			break; \
+		} \
+ \
+		if ((ptl[a] ^ flip) <= (ptr[b] ^ flip)) \
+		{ \
+			if (a + 16 > left) break; \
+ \
+			LOAD(v, ptl + a); a += 16; \
+		} \
+		else \
+		{ \
+			if (b + 16 > right) break; \
+ \
+			LOAD(v, ptr + b); b += 16; \
+		} \
+		head += 16; \
+	} \
+ \
+	a = left - 16; b = right - 16; tail = 16; \
+ \
+	LOAD(v, ptl + a); LOAD((v + hi), ptr + b); \
+ \
+	while (1) \
+	{ \
+		MERGE; \
+		STORE(dest + nmemb - tail, (v + hi)); \
+ \
+		if (head + tail + 16 > nmemb || a == 0 || b == 0) \
+		{ \
+			break; \
+		} \
+ \
+		if ((ptl[a - 1] ^ flip) > (ptr[b - 1] ^ flip)) \
+		{ \
+			if (a < 16) break; \
+ \
+			a -= 16; LOAD((v + hi), ptl + a); \
+		} \
+		else \
+		{ \
+			if (b < 16) break; \
+ \
+			b -= 16; LOAD((v + hi), ptr + b); \
+		} \
+		tail += 16; \
+	} \
+ \
+	a = corank(ptl, ptr, left, right, head, flip); \
+	b = corank(ptl, ptr, left, right, nmemb - tail, flip); \
+ \
+	pta = ptl + a; tpa = ptl + b; \
+	ptb = ptr + head - a; tpb = ptr + nmemb - tail - b; \
+	ptd = dest + head; \
+ \
+	while (pta < tpa && ptb < tpb) \
+	{ \
+		*ptd++ = (*pta ^ flip) <= (*ptb ^ flip) ? *pta++ : *ptb++; \
+	} \
+	while (pta < tpa) \
+	{ \
+		*ptd++ = *pta++; \
+	} \
+	while (ptb < tpb) \
+	{ \
+		*ptd++ = *ptb++; \
+	} \
+}
+
+#define flux_avx2_load32(v, pta) \
+{ \
+	v[0] = _mm256_xor_si256(_mm256_loadu_si256((__m256i *) (pta)), vf); \
+	v[1] = _mm256_xor_si256(_mm256_loadu_si256((__m256i *) (pta + 8)), vf); \
+}
+
+#define flux_avx2_store32(ptd, v) \
+{ \
+	_mm256_storeu_si256((__m256i *) (ptd), _mm256_xor_si256(v[0], vf)); \
+	_mm256_storeu_si256((__m256i *) (ptd + 8), _mm256_xor_si256(v[1], vf)); \
+}
+
+#define flux_avx512_load32(v, pta) \
+{ \
+	v[0] = _mm512_xor_si512(_mm512_loadu_si512((pta)), vf); \
+}
+
+#define flux_avx512_store32(ptd, v) \
+{ \
+	_mm512_storeu_si512((ptd), _mm512_xor_si512(v[0], vf)); \
+}
+
+#define flux_avx512_load64(v, pta) \
+{ \
+	v[0] = _mm512_xor_si512(_mm512_loadu_si512((pta)), vf); \
+	v[1] = _mm512_xor_si512(_mm512_loadu_si512((pta + 8)), vf); \
+}
+
+#define flux_avx512_store64(ptd, v) \
+{ \
+	_mm512_storeu_si512((ptd), _mm512_xor_si512(v[0], vf)); \
+	_mm512_storeu_si512((ptd + 8), _mm512_xor_si512(v[1], vf)); \
+}
+
+#define flux_avx512_clean32(v, mask, shuffle) \
+{ \
+	vt = shuffle; v = _mm512_mask_blend_epi32(mask, _mm512_min_epi32(v, vt), _mm512_max_epi32(v, vt)); \
+}
+
+#define flux_avx512_clean64(v, mask, shuffle) \
+{ \
+	vt = shuffle; v = _mm512_mask_blend_epi64(mask, _mm512_min_epi64(v, vt), _mm512_max_epi64(v, vt)); \
+}
+
+// The unmasked AVX-512 intrinsics start from _mm512_undefined_epi32(), which
+// g++ reports as an uninitialized use, see avx512fintrin.h
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+
+// sorts v[0] and v[1] when both are sorted
+
+FLUX_TARGET_AVX512
+void flux_avx512_merge32(__m512i *v)
+{
+	__m512i vt, vr = _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	size_t i;
+
+	v[1] = _mm512_permutexvar_epi32(vr, v[1]);
+
+	vt = _mm512_min_epi32(v[0], v[1]); v[1] = _mm512_max_epi32(v[0], v[1]); v[0] = vt;
+
+	for (i = 0 ; i < 2 ; i++)
+	{
+		flux_avx512_clean32(v[i], 0xFF00, _mm512_shuffle_i64x2(v[i], v[i], _MM_SHUFFLE(1, 0, 3, 2)));
+		flux_avx512_clean32(v[i], 0xF0F0, _mm512_shuffle_i64x2(v[i], v[i], _MM_SHUFFLE(2, 3, 0, 1)));
+		flux_avx512_clean32(v[i], 0xCCCC, _mm512_shuffle_epi32(v[i], _MM_PERM_BADC));
+		flux_avx512_clean32(v[i], 0xAAAA, _mm512_shuffle_epi32(v[i], _MM_PERM_CDAB));
+	}
+}
+
+// sorts v[0..4) when v[0..2) and v[2..4) are sorted
+
+FLUX_TARGET_AVX512
+void flux_avx512_merge64(__m512i *v)
+{
+	__m512i vt, vr = _mm512_setr_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+	size_t i;
+
+	vt = _mm512_permutexvar_epi64(vr, v[2]); v[2] = _mm512_permutexvar_epi64(vr, v[3]); v[3] = vt;
+
+	for (i = 0 ; i < 2 ; i++)
+	{
+		vt = _mm512_min_epi64(v[i], v[i + 2]); v[i + 2] = _mm512_max_epi64(v[i], v[i + 2]); v[i] = vt;
+	}
+
+	for (i = 0 ; i < 4 ; i += 2)
+	{
+		vt = _mm512_min_epi64(v[i], v[i + 1]); v[i + 1] = _mm512_max_epi64(v[i], v[i + 1]); v[i] = vt;
+	}
+
+	for (i = 0 ; i < 4 ; i++)
+	{
+		flux_avx512_clean64(v[i], 0xF0, _mm512_shuffle_i64x2(v[i], v[i], _MM_SHUFFLE(1, 0, 3, 2)));
+		flux_avx512_clean64(v[i], 0xCC, _mm512_shuffle_i64x2(v[i], v[i], _MM_SHUFFLE(2, 3, 0, 1)));
+		flux_avx512_clean64(v[i], 0xAA, _mm512_shuffle_epi32(v[i], _MM_PERM_BADC));
+	}
+}
+
+// left and right must be at least 32
+
+FLUX_TARGET_AVX2
+void flux_avx2_twin32(int *dest, int *ptl, int *ptr, size_t left, size_t right, int flip)
+{
+	__m256i v[4], vf = _mm256_set1_epi32(flip);
+
+	flux_simd_twin(int, flux_avx2_merge32(v, 2), flux_avx2_load32, flux_avx2_store32, 2, flux_simd_corank32);
+}
+
+FLUX_TARGET_AVX512
+void flux_avx512_twin32(int *dest, int *ptl, int *ptr, size_t left, size_t right, int flip)
+{
+	__m512i v[2], vf = _mm512_set1_epi32(flip);
+
+	flux_simd_twin(int, flux_avx512_merge32(v), flux_avx512_load32, flux_avx512_store32, 1, flux_simd_corank32);
+}
+
+FLUX_TARGET_AVX512
+void flux_avx512_twin64(long long *dest, long long *ptl, long long *ptr, size_t left, size_t right, long long flip)
+{
+	__m512i v[4], vf = _mm512_set1_epi64(flip);
+
+	flux_simd_twin(long long, flux_avx512_merge64(v), flux_avx512_load64, flux_avx512_store64, 2, flux_simd_corank64);
+}
+
+#pragma GCC diagnostic pop
+
+// Returns 0 if there is no suitable kernel or a run is too short, in which
+// case the caller should merge the runs. AVX2 lacks 64 bit min and max, so
+// 64 bit keys are only merged with AVX-512.
+
+int flux_simd_twin32(int *dest, int *ptl, int *ptr, size_t left, size_t right, int flip)
+{
+	if (left < 32 || right < 32)
+	{
+		return 0;
+	}
+
+	switch (flux_simd_level())
+	{
+		case FLUX_AVX512:
+			flux_avx512_twin32(dest, ptl, ptr, left, right, flip);
+			return 1;
+		case FLUX_AVX2:
+			flux_avx2_twin32(dest, ptl, ptr, left, right, flip);
+			return 1;
+	}
+	return 0;
+}
+
+int flux_simd_twin64(long long *dest, long long *ptl, long long *ptr, size_t left, size_t right, long long flip)
+{
+	if (left < 32 || right < 32 || flux_simd_level() < FLUX_AVX512)
+	{
+		return 0;
+	}
+	flux_avx512_twin64(dest, ptl, ptr, left, right, flip);
+
+	return 1;
+}
+
+int flux_simd_twin_int32(int *dest, int *ptl, int *ptr, size_t left, size_t right)
+{
+	return flux_simd_twin32(dest, ptl, ptr, left, right, 0);
+}
+
+int flux_simd_twin_uint32(unsigned int *dest, unsigned int *ptl, unsigned int *ptr, size_t left, size_t right)
+{
+	return flux_simd_twin32((int *) dest, (int *) ptl, (int *) ptr, left, right, INT_MIN);
+}
+
+int flux_simd_twin_int64(long long *dest, long long *ptl, long long *ptr, size_t left, size_t right)
+{
+	return flux_simd_twin64(dest, ptl, ptr, left, right, 0);
+}
+
+int flux_simd_twin_uint64(unsigned long long *dest, unsigned long long *ptl, unsigned long long *ptr, size_t left, size_t right)
+{
+	return flux_simd_twin64((long long *) dest, (long long *) ptl, (long long *) ptr, left, right, LLONG_MIN);
+}
+
+size_t flux_simd_split_int32(int *array, int *swap, int *ptx, int piv, size_t nmemb, int reverse, size_t *m, size_t *run)
+{
+	return flux_simd_split32(array, swap, ptx, piv, nmemb, reverse, m, run, 0);
+}
+
+size_t flux_simd_split_uint32(unsigned int *array, unsigned int *swap, unsigned int *ptx, unsigned int piv, size_t nmemb, int reverse, size_t *m, size_t *run)
+{
+	return flux_simd_split32((int *) array, (int *) swap, (int *) ptx, (int) piv, nmemb, reverse, m, run, INT_MIN);
+}
+
+size_t flux_simd_split_int64(long long *array, long long *swap, long long *ptx, long long piv, size_t nmemb, int reverse, size_t *m, size_t *run)
+{
+	return flux_simd_split64(array, swap, ptx, piv, nmemb, reverse, m, run, 0);
+}
+
+size_t flux_simd_split_uint64(unsigned long long *array, unsigned long long *swap, unsigned long long *ptx, unsigned long long piv, size_t nmemb, int reverse, size_t *m, size_t *run)
+{
+	return flux_simd_split64((long long *) array, (long long *) swap, (long long *) ptx, (long long) piv, nmemb, reverse, m, run, LLONG_MIN);
+}
+
+#endif
+
+#endif
@@ -147,6 +147,12 @@ void FUNC(parity_merge)(VAR *dest, VAR *from, size_t left, size_t right, CMPFUNC
 	VAR *ptl, *ptr, *tpl, *tpr, *tpd, *ptd;
 #if !defined __clang__
 	size_t x, y;
+#endif
+#if defined FLUX_SIMD && defined QUAD_PRIM
+	if (left >= 32 && FUNC(flux_simd_twin)(dest, from, from + left, left, right))
+	{
+		return;
+	}
 #endif
 	ptl = from;
 	ptr = from + left;
@@ -184,6 +190,12 @@ void FUNC(parity_merge)(VAR *dest, VAR *from, size_t left, size_t right, CMPFUNC
 
 void FUNC(tail_swap)(VAR *array, VAR *swap, size_t nmemb, CMPFUNC *cmp)
 {
+#if defined FLUX_SIMD && defined QUAD_PRIM
+	if (nmemb > 16 && FUNC(flux_simd_sort)(array, nmemb))
+	{
+		return;
+	}
+#endif
 	if (nmemb < 8)
 	{
 		FUNC(tiny_sort)(array, swap, nmemb, cmp);
@@ -413,28 +425,27 @@ size_t FUNC(quad_swap)(VAR *array, size_t nmemb, CMPFUNC *cmp)
 	return 0;
 }
 
-// The next six functions are quad merge support routines
+// The next seven functions are quad merge support routines
 
-void FUNC(cross_merge)(VAR *dest, VAR *from, size_t left, size_t right, CMPFUNC *cmp)
+// merges ptl and ptr, which don't need to be adjacent, left and right must
+// be at least 1
+
+void FUNC(twin_merge)(VAR *dest, VAR *ptl, VAR *ptr, size_t left, size_t right, CMPFUNC *cmp)
 {
-	VAR *ptl, *tpl, *ptr, *tpr, *ptd, *tpd;
+	VAR *tpl, *tpr, *ptd, *tpd;
 	size_t loop;
 #if !defined __clang__
 	size_t x, y;
 #endif
-	ptl = from;
-	ptr = from + left;
-	tpl = ptr - 1;
-	tpr = tpl + right;
-
-	if (left + 1 >= right && right >= left && left >= 32)
+#if defined FLUX_SIMD && defined QUAD_PRIM
+	if (FUNC(flux_simd_twin)(dest, ptl, ptr, left, right))
 	{
-		if (cmp(ptl + 15, ptr) > 0 && cmp(ptl, ptr + 15) <= 0 && cmp(tpl, tpr - 15) > 0 && cmp(tpl - 15, tpr) <= 0)
-		{
-			FUNC(parity_merge)(dest, from, left, right, cmp);
-			return;
-		}
+		return;
 	}
+#endif
+	tpl = ptl + left - 1;
+	tpr = ptr + right - 1;
+
 	ptd = dest;
 	tpd = dest + left + right - 1;
 
@@ -515,6 +526,26 @@ void FUNC(cross_merge)(VAR *dest, VAR *from, size_t left, size_t right, CMPFUNC
 	}
 }
 
+void FUNC(cross_merge)(VAR *dest, VAR *from, size_t left, size_t right, CMPFUNC *cmp)
+{
+	VAR *ptl, *tpl, *ptr, *tpr;
+
+	ptl = from;
+	ptr = from + left;
+	tpl = ptr - 1;
+	tpr = tpl + right;
+
+	if (left + 1 >= right && right >= left && left >= 32)
+	{
+		if (cmp(ptl + 15, ptr) > 0 && cmp(ptl, ptr + 15) <= 0 && cmp(tpl, tpr - 15) > 0 && cmp(tpl - 15, tpr) <= 0)
+		{
+			FUNC(parity_merge)(dest, from, left, right, cmp);
+			return;
+		}
+	}
+	FUNC(twin_merge)(dest, ptl, ptr, left, right, cmp);
+}
+
 void FUNC(quad_merge_block)(VAR *array, VAR *swap, size_t block, CMPFUNC *cmp)
 {
 	VAR *pt1, *pt2, *pt3;
@@ -1076,10 +1107,11 @@ void FUNC(quadsort)(void *array, size_t nmemb, CMPFUNC *cmp)
 	{
 		VAR *swap = NULL;
 		size_t block, swap_size = nmemb;
+		struct flux_alloc *policy = flux_swap_policy;
 
 		if (nmemb > 4194304) for (swap_size = 4194304 ; swap_size * 8 <= nmemb ; swap_size *= 4) {}
 
-		swap = (VAR *) malloc(swap_size * sizeof(VAR));
+		swap = (VAR *) policy->alloc(swap_size * sizeof(VAR));
 
 		if (swap == NULL)
 		{
@@ -1095,7 +1127,7 @@ void FUNC(quadsort)(void *array, size_t nmemb, CMPFUNC *cmp)
 
 		FUNC(rotate_merge)(pta, swap, swap_size, nmemb, block, cmp);
 
-		free(swap);
+		policy->release(swap, swap_size * sizeof(VAR));
 	}
 }
 
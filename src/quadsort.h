@@ -14,6 +14,18 @@
 
 typedef int CMPFUNC (const void *a, const void *b);
 
+#ifndef FLUXSORT_SIMD_H
+  #include "fluxsort_simd.h"
+#endif
+
+#ifndef FLUXSORT_COUNT_H
+  #include "fluxsort_count.h"
+#endif
+
+#ifndef FLUXSORT_ALLOC_H
+  #include "fluxsort_alloc.h"
+#endif
+
 //#define cmp(a,b) (*(a) > *(b))
 
 
@@ -132,7 +144,9 @@ typedef int CMPFUNC (const void *a, const void *b);
 #define FUNC(NAME) NAME##_int32
 #ifndef cmp
   #define cmp(a,b) (*(a) > *(b))
+  #define QUAD_PRIM
   #include "quadsort.c"
+  #undef QUAD_PRIM
   #undef cmp
 #else
   #include "quadsort.c"
@@ -144,7 +158,9 @@ typedef int CMPFUNC (const void *a, const void *b);
 #define FUNC(NAME) NAME##_uint32
 #ifndef cmp
   #define cmp(a,b) (*(a) > *(b))
+  #define QUAD_PRIM
   #include "quadsort.c"
+  #undef QUAD_PRIM
   #undef cmp
 #else
   #include "quadsort.c"
@@ -177,7 +193,9 @@ typedef int CMPFUNC (const void *a, const void *b);
 #define FUNC(NAME) NAME##_int64
 #ifndef cmp
   #define cmp(a,b) (*(a) > *(b))
+  #define QUAD_PRIM
   #include "quadsort.c"
+  #undef QUAD_PRIM
   #undef cmp
 #else
   #include "quadsort.c"
@@ -189,7 +207,9 @@ typedef int CMPFUNC (const void *a, const void *b);
 #define FUNC(NAME) NAME##_uint64
 #ifndef cmp
   #define cmp(a,b) (*(a) > *(b))
+  #define QUAD_PRIM
   #include "quadsort.c"
+  #undef QUAD_PRIM
   #undef cmp
 #else
   #include "quadsort.c"
@@ -197,6 +217,19 @@ typedef int CMPFUNC (const void *a, const void *b);
 #undef VAR
 #undef FUNC
 
+// fluxsort_prim_kv() packs a 32 bit key and a 32 bit value in one element,
+// only the key in the upper half is compared so the sort remains stable.
+
+#ifndef cmp
+  #define VAR unsigned long long
+  #define FUNC(NAME) NAME##_pack64
+  #define cmp(a,b) ((*(a) >> 32) > (*(b) >> 32))
+  #include "quadsort.c"
+  #undef cmp
+  #undef VAR
+  #undef FUNC
+#endif
+
 // This section is outside of 32/64 bit pointer territory, so no cache checks
 // necessary, unless sorting 32+ byte structures.
 
@@ -274,16 +307,60 @@ typedef int CMPFUNC (const void *a, const void *b);
 //└─────────────────────────────────────────────────────┘//
 ///////////////////////////////////////////////////////////
 
-/*
+// Records of 12, 16, 24, 32, and 64 bytes are moved by value, so they stay
+// contiguous while the comparison function is called by reference. A 16 byte
+// record can't go through the long double functions, which may only copy the
+// 10 bytes that hold the value. The cmp macro can't compare structures, so
+// these are left out when it is defined.
+
+#ifndef cmp
+
+typedef struct {char bytes[12];} struct96;
+#define VAR struct96
+#define FUNC(NAME) NAME##_struct96
+
+#include "quadsort.c"
+
+#undef VAR
+#undef FUNC
+
+typedef struct {char bytes[16];} struct128;
+#define VAR struct128
+#define FUNC(NAME) NAME##_struct128
+
+#include "quadsort.c"
+
+#undef VAR
+#undef FUNC
+
+typedef struct {char bytes[24];} struct192;
+#define VAR struct192
+#define FUNC(NAME) NAME##_struct192
+
+#include "quadsort.c"
+
+#undef VAR
+#undef FUNC
+
 typedef struct {char bytes[32];} struct256;
 #define VAR struct256
-#define FUNC(NAME) NAME##256
+#define FUNC(NAME) NAME##_struct256
 
 #include "quadsort.c"
 
 #undef VAR
 #undef FUNC
-*/
+
+typedef struct {char bytes[64];} struct512;
+#define VAR struct512
+#define FUNC(NAME) NAME##_struct512
+
+#include "quadsort.c"
+
+#undef VAR
+#undef FUNC
+
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 //┌─────────────────────────────────────────────────────────────────────────┐//
@@ -296,6 +373,128 @@ typedef struct {char bytes[32];} struct256;
 //└─────────────────────────────────────────────────────────────────────────┘//
 ///////////////////////////////////////////////////////////////////////////////
 
+// Moves every record to its sorted position by following the cycles of the
+// permutation, so only one record is held aside at a time. pti[index] points
+// to the record that belongs at index, entries are reset as they are placed.
+
+void quad_permute_size(char *array, char **pti, size_t nmemb, size_t size)
+{
+	char stack[256], *tmp, *ptd, *pts;
+	size_t index, cur;
+
+	tmp = size <= sizeof(stack) ? stack : (char *) malloc(size);
+
+	assert(tmp != NULL);
+
+	for (index = 0 ; index < nmemb ; index++)
+	{
+		ptd = array + index * size;
+
+		if (pti[index] == ptd)
+		{
+			continue;
+		}
+		memcpy(tmp, ptd, size);
+
+		cur = index;
+		pts = pti[cur];
+
+		while (pts != array + index * size)
+		{
+			memcpy(ptd, pts, size);
+			pti[cur] = ptd;
+
+			cur = (pts - array) / size;
+			ptd = pts;
+			pts = pti[cur];
+		}
+		memcpy(ptd, tmp, size);
+		pti[cur] = ptd;
+	}
+
+	if (tmp != stack)
+	{
+		free(tmp);
+	}
+}
+
+// Sort arrays of structures, the comparison function must be by reference.
+// The sort works on an array of pointers, which is placed in swap together
+// with its own swap when swap_bytes allows, so no memory is allocated if
+// swap holds 2 * nmemb pointers.
+
+void quadsort_size_swap(void *array, void *swap, size_t swap_bytes, size_t nmemb, size_t size, CMPFUNC *cmp)
+{
+	char **pti, *pta;
+	size_t index, offset;
+
+	if (nmemb < 2)
+	{
+		return;
+	}
+	pta = (char *) array;
+
+	if (swap_bytes >= nmemb * sizeof(char *))
+	{
+		pti = (char **) swap;
+		swap_bytes -= nmemb * sizeof(char *);
+	}
+	else
+	{
+		pti = (char **) malloc(nmemb * sizeof(char *));
+		swap_bytes = 0;
+
+		assert(pti != NULL);
+	}
+
+	for (index = offset = 0 ; index < nmemb ; index++)
+	{
+		pti[index] = pta + offset;
+
+		offset += size;
+	}
+
+	if (swap_bytes >= nmemb * sizeof(char *))
+	{
+		switch (sizeof(size_t))
+		{
+			case 4: quadsort_swap32(pti, pti + nmemb, nmemb, nmemb, cmp); break;
+			case 8: quadsort_swap64(pti, pti + nmemb, nmemb, nmemb, cmp); break;
+		}
+	}
+	else
+	{
+		switch (sizeof(size_t))
+		{
+			case 4: quadsort32(pti, nmemb, cmp); break;
+			case 8: quadsort64(pti, nmemb, cmp); break;
+		}
+	}
+
+	quad_permute_size(pta, pti, nmemb, size);
+
+	if (pti != swap)
+	{
+		free(pti);
+	}
+}
+
+void quadsort_size(void *array, size_t nmemb, size_t size, CMPFUNC *cmp)
+{
+	quadsort_size_swap(array, NULL, 0, nmemb, size, cmp);
+}
+
+// Other record sizes passed to quadsort() and fluxsort() are sorted through
+// quadsort_size() and fluxsort_size(), which call the comparison function
+// with pointers to pointers. quad_size_cmp() hands the records themselves to
+// the comparison function of the calling thread.
+
+__thread CMPFUNC *quad_size_func;
+
+int quad_size_cmp(const void *a, const void *b)
+{
+	return quad_size_func(*(char * const *) a, *(char * const *) b);
+}
 
 void quadsort(void *array, size_t nmemb, size_t size, CMPFUNC *cmp)
 {
@@ -321,22 +520,99 @@ void quadsort(void *array, size_t nmemb, size_t size, CMPFUNC *cmp)
 		case sizeof(long long):
 			quadsort64(array, nmemb, cmp);
 			return;
-#if (DBL_MANT_DIG < LDBL_MANT_DIG)
+#ifndef cmp
+		case sizeof(struct96):
+			quadsort_struct96(array, nmemb, cmp);
+			return;
+
+		case sizeof(struct128):
+			quadsort_struct128(array, nmemb, cmp);
+			return;
+
+		case sizeof(struct192):
+			quadsort_struct192(array, nmemb, cmp);
+			return;
+
+		case sizeof(struct256):
+			quadsort_struct256(array, nmemb, cmp);
+			return;
+
+		case sizeof(struct512):
+			quadsort_struct512(array, nmemb, cmp);
+			return;
+
+		default:
+		{
+			CMPFUNC *func = quad_size_func;
+
+			quad_size_func = cmp;
+			quadsort_size(array, nmemb, size, quad_size_cmp);
+			quad_size_func = func;
+		}
+#else
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
 		case sizeof(long double):
 			quadsort128(array, nmemb, cmp);
 			return;
-#endif
-//		case sizeof(struct256):
-//			quadsort256(array, nmemb, cmp);
-//			return;
+  #endif
 
 		default:
-#if (DBL_MANT_DIG < LDBL_MANT_DIG)
+  #if (DBL_MANT_DIG < LDBL_MANT_DIG)
 			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long) || size == sizeof(long double));
-#else
+  #else
 			assert(size == sizeof(char) || size == sizeof(short) || size == sizeof(int) || size == sizeof(long long));
+  #endif
 #endif
-//			qsort(array, nmemb, size, cmp);
+	}
+}
+
+// Floats and doubles are sorted as unsigned integers. Their bits are mapped
+// to keys that follow the IEEE 754 total order, -0 before +0, after which the
+// keys are rotated so every NaN, whatever its sign, ends up after +inf. The
+// positive NaNs come first, followed by the negative NaNs.
+
+#define PRIM_FLOAT_NAN  0x007FFFFFU
+#define PRIM_DOUBLE_NAN 0x000FFFFFFFFFFFFFULL
+
+void prim_float_keys(unsigned int *array, size_t nmemb)
+{
+	unsigned int *pta;
+
+	for (pta = array ; pta < array + nmemb ; pta++)
+	{
+		*pta = (*pta ^ ((*pta >> 31) ? 0xFFFFFFFFU : 0x80000000U)) - PRIM_FLOAT_NAN;
+	}
+}
+
+void prim_float_bits(unsigned int *array, size_t nmemb)
+{
+	unsigned int *pta;
+
+	for (pta = array ; pta < array + nmemb ; pta++)
+	{
+		*pta += PRIM_FLOAT_NAN;
+		*pta ^= (*pta >> 31) ? 0x80000000U : 0xFFFFFFFFU;
+	}
+}
+
+void prim_double_keys(unsigned long long *array, size_t nmemb)
+{
+	unsigned long long *pta;
+
+	for (pta = array ; pta < array + nmemb ; pta++)
+	{
+		*pta = (*pta ^ ((*pta >> 63) ? 0xFFFFFFFFFFFFFFFFULL : 0x8000000000000000ULL)) - PRIM_DOUBLE_NAN;
+	}
+}
+
+void prim_double_bits(unsigned long long *array, size_t nmemb)
+{
+	unsigned long long *pta;
+
+	for (pta = array ; pta < array + nmemb ; pta++)
+	{
+		*pta += PRIM_DOUBLE_NAN;
+		*pta ^= (*pta >> 63) ? 0x8000000000000000ULL : 0xFFFFFFFFFFFFFFFFULL;
 	}
 }
 
@@ -363,12 +639,40 @@ void quadsort_prim(void *array, size_t nmemb, size_t size)
 
 	switch (size)
 	{
+		case 0:
+			flux_count8((unsigned char *) array, nmemb, 0);
+			return;
+		case 1:
+			flux_count8((unsigned char *) array, nmemb, 0x80);
+			return;
+		case 2:
+			if (flux_count16((unsigned short *) array, nmemb, 0x8000) == 0)
+			{
+				quadsort16(array, nmemb, flux_cmp_int16);
+			}
+			return;
+		case 3:
+			if (flux_count16((unsigned short *) array, nmemb, 0) == 0)
+			{
+				quadsort16(array, nmemb, flux_cmp_uint16);
+			}
+			return;
 		case 4:
 			quadsort_int32(array, nmemb, NULL);
 			return;
 		case 5:
 			quadsort_uint32(array, nmemb, NULL);
 			return;
+		case 6:
+			prim_float_keys((unsigned int *) array, nmemb);
+			quadsort_uint32(array, nmemb, NULL);
+			prim_float_bits((unsigned int *) array, nmemb);
+			return;
+		case 7:
+			prim_double_keys((unsigned long long *) array, nmemb);
+			quadsort_uint64(array, nmemb, NULL);
+			prim_double_bits((unsigned long long *) array, nmemb);
+			return;
 		case 8:
 			quadsort_int64(array, nmemb, NULL);
 			return;
@@ -376,58 +680,11 @@ void quadsort_prim(void *array, size_t nmemb, size_t size)
 			quadsort_uint64(array, nmemb, NULL);
 			return;
 		default:
-			assert(size == sizeof(int) || size == sizeof(int) + 1 || size == sizeof(long long) || size == sizeof(long long) + 1);
+			assert(size <= 9);
 			return;
 	}
 }
 
-// Sort arrays of structures, the comparison function must be by reference.
-
-void quadsort_size(void *array, size_t nmemb, size_t size, CMPFUNC *cmp)
-{
-	char **pti, *pta, *pts;
-	size_t index, offset;
-
-	if (nmemb < 2)
-	{
-		return;
-	}
-	pta = (char *) array;
-	pti = (char **) malloc(nmemb * sizeof(char *));
-
-	assert(pti != NULL);
-
-	for (index = offset = 0 ; index < nmemb ; index++)
-	{
-		pti[index] = pta + offset;
-
-		offset += size;
-	}
-
-	switch (sizeof(size_t))
-	{
-		case 4: quadsort32(pti, nmemb, cmp); break;
-		case 8: quadsort64(pti, nmemb, cmp); break;
-	}
-
-	pts = (char *) malloc(nmemb * size);
-
-	assert(pts != NULL);
-	
-	for (index = 0 ; index < nmemb ; index++)
-	{
-		memcpy(pts, pti[index], size);
-
-		pts += size;
-	}
-	pts -= nmemb * size;
-
-	memcpy(array, pts, nmemb * size);
-
-	free(pti);
-	free(pts);
-}
-
 #undef QUAD_CACHE
 
 #endif